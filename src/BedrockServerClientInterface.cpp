@@ -6,11 +6,22 @@
 #include <ll/api/mod/RegisterHelper.h>
 #include <ll/api/utils/ErrorUtils.h>
 
-#ifdef TEST
 #include "bsci/GeometryGroup.h"
+#include "bsci/command/Command.h"
+#include "bsci/debug_draw/DebugDrawingHandler.h"
+#include "bsci/network/SendScheduler.h"
+#include "bsci/particle/ParticleSpawner.h"
+#include "bsci/snapshot/SnapshotStore.h"
+#include "bsci/utils/Metrics.h"
+
+#ifdef TEST
 #include "bsci/test/Test.h"
 #endif
 
+#ifdef BENCH
+#include "bsci/bench/Bench.h"
+#endif
+
 namespace bsci {
 
 struct BedrockServerClientInterface::Impl {
@@ -37,23 +48,42 @@ std::filesystem::path BedrockServerClientInterface::getConfigPath() const {
     return getSelf().getConfigDir() / u8"config.json";
 }
 
+void BedrockServerClientInterface::setConfig(Config config) {
+    std::lock_guard l{mConfigMutex};
+    auto const&     res = mConfigs.emplace_back(std::make_unique<Config const>(std::move(config)));
+    mConfig.store(res.get(), std::memory_order_release);
+}
+
 bool BedrockServerClientInterface::loadConfig() {
-    bool res{};
-    mConfig.emplace();
+    bool   res{};
+    Config config;
     try {
-        res = ll::config::loadConfig(*mConfig, getConfigPath());
+        res = ll::config::loadConfig(config, getConfigPath());
     } catch (...) {
         ll::error_utils::printCurrentException(getLogger());
         res = false;
     }
     if (!res) {
-        res = ll::config::saveConfig(*mConfig, getConfigPath());
+        res = ll::config::saveConfig(config, getConfigPath());
     }
+    setConfig(std::move(config));
     return res;
 }
 
 bool BedrockServerClientInterface::saveConfig() {
-    return ll::config::saveConfig(*mConfig, getConfigPath());
+    return ll::config::saveConfig(getConfig(), getConfigPath());
+}
+
+bool BedrockServerClientInterface::reloadConfig() {
+    Config config;
+    try {
+        if (!ll::config::loadConfig(config, getConfigPath())) return false;
+    } catch (...) {
+        ll::error_utils::printCurrentException(getLogger());
+        return false;
+    }
+    setConfig(std::move(config));
+    return true;
 }
 
 bool BedrockServerClientInterface::load() {
@@ -64,9 +94,18 @@ bool BedrockServerClientInterface::load() {
 }
 
 bool BedrockServerClientInterface::enable() {
-    if (!mConfig) {
+    if (!mConfig.load()) {
         loadConfig();
     }
+    command::registerCommand();
+    metrics::startSampling();
+    SendScheduler::getInstance().start();
+    GeometryGroup::startMotion();
+    DebugDrawingHandler::startReplays();
+    ParticleSpawner::startReplays();
+    if (auto restored = snapshot::restoreAll()) {
+        getLogger().info("Restored {} persistent geometry groups", restored);
+    }
 #ifdef TEST
     impl->geoTest = GeometryGroup::createDefault();
     test::registerTestCommand(impl->geoTest, impl->gids);
@@ -86,11 +125,22 @@ bool BedrockServerClientInterface::enable() {
             std::this_thread::sleep_for(1s);
         }
     }).detach();
+#endif
+#ifdef BENCH
+    std::thread([] { bench::runBenchmarks(); }).detach();
 #endif
     return true;
 }
 
 bool BedrockServerClientInterface::disable() {
+    if (auto saved = snapshot::saveAll()) {
+        getLogger().info("Saved {} persistent geometry groups", saved);
+    }
+    metrics::stopSampling();
+    SendScheduler::getInstance().stop();
+    GeometryGroup::stopMotion();
+    DebugDrawingHandler::stopReplays();
+    ParticleSpawner::stopReplays();
     saveConfig();
     return true;
 }
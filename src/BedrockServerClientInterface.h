@@ -1,5 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <ll/api/mod/NativeMod.h>
 
 #include "Config.h"
@@ -14,7 +19,10 @@ class BedrockServerClientInterface {
 
     ll::mod::NativeMod& self;
 
-    std::optional<Config> mConfig;
+    // 配置以不可变快照发布，读取时不加锁；发布过的快照保留到析构，已取得的引用一直有效
+    std::atomic<Config const*>                 mConfig{};
+    std::mutex                                 mConfigMutex;
+    std::vector<std::unique_ptr<Config const>> mConfigs;
 
 public:
     BedrockServerClientInterface();
@@ -26,7 +34,12 @@ class BedrockServerClientInterface {
 
     [[nodiscard]] ll::io::Logger& getLogger() const { return getSelf().getLogger(); }
 
-    [[nodiscard]] Config& getConfig() { return *mConfig; }
+    [[nodiscard]] Config const& getConfig() const {
+        return *mConfig.load(std::memory_order_acquire);
+    }
+
+    // 发布新的配置快照，之后的getConfig返回它；修改配置时复制一份改好后再发布
+    void setConfig(Config config);
 
     [[nodiscard]] std::filesystem::path getConfigPath() const;
 
@@ -34,6 +47,9 @@ class BedrockServerClientInterface {
 
     bool saveConfig();
 
+    // 运行时重新读取配置，失败时保留当前配置
+    bool reloadConfig();
+
     bool load();
 
     bool enable();
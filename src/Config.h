@@ -2,26 +2,46 @@
 
 namespace bsci {
 struct Config {
-    int version = 3;
+    int version = 4;
 
     std::string defaultGroup = "debugDraw";
 
     struct {
-        size_t maxCircleSegments  = 128;
-        double minCircleSpacing   = 0.6;
-        size_t maxSphereCells     = 10;
-        double minSphereSpacing   = 0.6;
-        double extraTime          = 0.05;
-        size_t tablePerTick       = 2;
-        double defaultThickness   = 0.1;
-        double defaultPointRadius = 0.3;
-        bool   delayUndate        = false;
+        size_t maxCircleSegments    = 128;
+        double minCircleSpacing     = 0.6;
+        size_t maxSphereCells       = 10;
+        double minSphereSpacing     = 0.6;
+        double curveTolerance       = 0.05; // 曲线细分后与真实曲线的最大偏差
+        size_t maxCurveSegments     = 256;  // 每段三次贝塞尔曲线最多细分的段数
+        double extraTime            = 0.05;
+        size_t tablePerTick         = 2;
+        double defaultThickness     = 0.1;
+        double defaultPointRadius   = 0.3;
+        bool   delayUndate          = false;
+        // 长寿命粒子发出后无法撤回，shift、remove、update后旧粒子仍会在原处留存至多
+        // keepAliveTime + extraTime秒，只适合静止的图形；会移动的图形请用默认模式
+        bool   persistent           = false;
+        double keepAliveTime        = 30.0;
+        size_t replayPacketsPerTick = 64; // 区块加载后每tick最多补发的持久粒子包数，0为不限制
     } particle{};
     struct {
-        bool useNativeCircle = false;
-        bool useNativeSphere = false;
+        bool   useNativeCircle      = false;
+        bool   useNativeSphere      = false;
+        size_t replayPacketsPerTick = 64; // 区块加载后每tick最多补发的包数，0为不限制；不走budget
         std::optional<uchar> sphereSegments;
         std::optional<uchar> arrowSegments;
     } debugDraw{};
+    struct {
+        bool   enabled        = false; // 开启后新图形和观看者补发经由每tick限量的队列发送
+        size_t packetsPerTick = 256; // 每个玩家
+        size_t bytesPerTick   = 0;   // 每个玩家，0为不限制
+        double nearbyRadius   = 256;
+    } budget{};
+    struct {
+        bool countBytes = false; // 需要额外序列化每个包
+    } stats{};
+    struct {
+        size_t shiftInterval = 4; // 服务端驱动的运动每隔多少tick移动一次
+    } motion{};
 };
 } // namespace bsci
\ No newline at end of file
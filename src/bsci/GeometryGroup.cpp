@@ -1,17 +1,582 @@
 #include "GeometryGroup.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <mutex>
 #include <numbers>
 #include <ranges>
+#include <unordered_map>
+#include <vector>
+
+#include <ll/api/base/Containers.h>
+#include <ll/api/event/EventBus.h>
+#include <ll/api/event/Listener.h>
+#include <ll/api/event/world/ServerLevelTickEvent.h>
 
 #include "BedrockServerClientInterface.h"
 #include "bsci/debug_draw/DebugDrawingHandler.h"
 #include "bsci/particle/ParticleSpawner.h"
+#include "bsci/shared/SharedGeometryGroup.h"
+#include "bsci/snapshot/SnapshotStore.h"
 #include "bsci/utils/Math.h"
+#include "bsci/utils/SpatialIndex.h"
 
 
 namespace bsci {
 
 
+static std::mutex                  groupsMutex;
+static std::vector<GeometryGroup*> groups;
+static ll::event::ListenerPtr      motionListener;
+
+struct GeometryGroup::RecipeBook {
+    struct Record {
+        Recipe recipe;
+        uint64 signature; // 细分时使用的配置参数
+        Vec3   offset{};  // 之后累计的平移
+    };
+    ll::ConcurrentDenseMap<GeoId, Record> records;
+
+    // 影响细分结果的配置参数，变化时才需要重新细分
+    static uint64 signatureOf(Recipe const& recipe) {
+        auto const& config = BedrockServerClientInterface::getInstance().getConfig().debugDraw;
+        auto const  segments = [](std::optional<uchar> const& value) {
+            return (uint64)value.has_value() << 8 | value.value_or(0);
+        };
+        switch (recipe.kind) {
+        case RecipeKind::Circle:
+            return circleSegments(recipe.radius) << 1 | config.useNativeCircle;
+        case RecipeKind::Cylinder:
+            return circleSegments(recipe.radius);
+        case RecipeKind::Cone:
+            return circleSegments(recipe.radius) << 32 | circleSegments(recipe.radius2);
+        case RecipeKind::Sphere:
+            return sphereCells(recipe.radius) << 10 | (uint64)config.useNativeSphere << 9
+                 | segments(config.sphereSegments);
+        case RecipeKind::Arrow:
+            return segments(config.arrowSegments);
+        case RecipeKind::Curve: {
+            auto const& particle = BedrockServerClientInterface::getInstance().getConfig().particle;
+            return std::bit_cast<uint64>(particle.curveTolerance) * 31 + particle.maxCurveSegments;
+        }
+        }
+        return 0;
+    }
+};
+
+struct GeometryGroup::MotionBook {
+    struct Entry {
+        Motion                                motion;
+        std::chrono::steady_clock::time_point start;
+        Vec3                                  applied{}; // 已经shift过的位移
+    };
+    ll::ConcurrentDenseMap<GeoId, Entry> entries;
+};
+
+// 线段没有粗细时按此半径判断射线和最近点是否命中
+constexpr float minPickRadius = 0.1f;
+
+// 每个GeoId在各个维度中的包围盒，merge后只保留合并出的GeoId
+struct GeometryGroup::SpatialBook {
+    struct Placement {
+        int                 dim;
+        SpatialIndex::Proxy proxy;
+    };
+    // 线段外扩radius得到的胶囊体，用于细检测
+    struct Capsule {
+        int   dim;
+        Vec3  begin;
+        Vec3  end;
+        float radius;
+    };
+    struct Entry {
+        std::vector<Placement> placements;
+        std::vector<Capsule>   capsules;
+        bool                   exact{true}; // 有部分只登记了包围盒时为false，整体按包围盒判断
+    };
+    // take取出的内容，可以平移后原样放回
+    struct Taken {
+        std::vector<std::pair<int, AABB>> boxes;
+        std::vector<Capsule>              capsules;
+        bool                              exact{true};
+    };
+    std::mutex                        mutex;
+    std::map<int, SpatialIndex>       trees;
+    std::unordered_map<uint64, Entry> entries;
+
+    // 以下需持有mutex
+    void place(GeoId id, int dim, AABB const& box, bool exact = false) {
+        auto& entry = entries[id.value];
+        auto& tree  = trees[dim];
+        if (!exact) entry.exact = false;
+        for (auto& p : entry.placements) {
+            if (p.dim != dim) continue;
+            tree.update(p.proxy, SpatialIndex::unite(tree.bounds(p.proxy), box));
+            return;
+        }
+        entry.placements.emplace_back(dim, tree.insert(box, id.value));
+    }
+
+    void place(GeoId id, Capsule const& capsule) {
+        Vec3 const r{capsule.radius, capsule.radius, capsule.radius};
+        auto const box = SpatialIndex::unite(
+            {capsule.begin - r, capsule.begin + r},
+            {capsule.end - r, capsule.end + r}
+        );
+        place(id, capsule.dim, box, true);
+        entries[id.value].capsules.push_back(capsule);
+    }
+
+    Taken take(GeoId id) {
+        Taken res;
+        auto  node = entries.extract(id.value);
+        if (!node) return res;
+        auto& entry = node.mapped();
+        for (auto& p : entry.placements) {
+            auto& tree = trees[p.dim];
+            res.boxes.emplace_back(p.dim, tree.bounds(p.proxy));
+            tree.remove(p.proxy);
+        }
+        res.capsules = std::move(entry.capsules);
+        res.exact    = entry.exact;
+        return res;
+    }
+
+    void put(GeoId id, Taken&& taken, Vec3 const& offset = Vec3::ZERO()) {
+        if (taken.boxes.empty()) return;
+        for (auto& [dim, box] : taken.boxes) {
+            place(id, dim, {box.min + offset, box.max + offset}, true);
+        }
+        auto& entry = entries[id.value];
+        entry.exact = entry.exact && taken.exact;
+        for (auto& capsule : taken.capsules) {
+            capsule.begin += offset;
+            capsule.end   += offset;
+            entry.capsules.push_back(capsule);
+        }
+    }
+
+    // 射线命中value的距离，没有精确几何时沿用进入包围盒的距离
+    std::optional<float> rayDistance(
+        uint64      value,
+        int         dim,
+        Vec3 const& origin,
+        Vec3 const& dir,
+        float       maxDist,
+        float       boxDistance
+    ) const {
+        auto it = entries.find(value);
+        if (it == entries.end() || !it->second.exact) return boxDistance;
+        auto const           end = origin + dir * maxDist;
+        std::optional<float> res;
+        for (auto& capsule : it->second.capsules) {
+            if (capsule.dim != dim) continue;
+            auto const [s, t]  = closestOnSegments(origin, end, capsule.begin, capsule.end);
+            auto const along   = s * maxDist;
+            auto const closest = capsule.begin + (capsule.end - capsule.begin) * t;
+            auto const gap     = (origin + dir * along - closest).length();
+            if (gap > capsule.radius) continue;
+            // 从最近处沿射线退回到进入胶囊体的位置，近似按垂直穿过计算
+            auto const d = std::max(
+                boxDistance,
+                along - std::sqrt(capsule.radius * capsule.radius - gap * gap)
+            );
+            if (!res || d < *res) res = d;
+        }
+        return res;
+    }
+
+    // pos到value的距离，没有精确几何时沿用到包围盒的距离
+    std::optional<float>
+    pointDistance(uint64 value, int dim, Vec3 const& pos, float boxDistance) const {
+        auto it = entries.find(value);
+        if (it == entries.end() || !it->second.exact) return boxDistance;
+        std::optional<float> res;
+        for (auto& capsule : it->second.capsules) {
+            if (capsule.dim != dim) continue;
+            auto const t       = closestOnSegments(pos, pos, capsule.begin, capsule.end).second;
+            auto const closest = capsule.begin + (capsule.end - capsule.begin) * t;
+            auto const d       = std::max(boxDistance, (pos - closest).length() - capsule.radius);
+            if (!res || d < *res) res = d;
+        }
+        return res;
+    }
+};
+
+static thread_local size_t recordDepth{};
+static thread_local size_t stageDepth{};
+
+GeometryGroup::RecordScope::RecordScope() : outermost(recordDepth++ == 0) {}
+
+GeometryGroup::RecordScope::~RecordScope() { --recordDepth; }
+
+GeometryGroup::StageScope::StageScope() { ++stageDepth; }
+
+GeometryGroup::StageScope::~StageScope() { --stageDepth; }
+
+bool GeometryGroup::isStaging() { return stageDepth != 0; }
+
+GeometryGroup::GeometryGroup()
+: recipes(std::make_unique<RecipeBook>()),
+  motions(std::make_unique<MotionBook>()),
+  spatial(std::make_unique<SpatialBook>()) {
+    std::lock_guard l{groupsMutex};
+    groups.push_back(this);
+}
+
+GeometryGroup::~GeometryGroup() { delist(); }
+
+void GeometryGroup::delist() {
+    std::lock_guard l{groupsMutex};
+    std::erase(groups, this);
+}
+
+// fn在持有groupsMutex时调用，正在析构的组会在delist处等待遍历结束
+void GeometryGroup::forEach(std::function<void(GeometryGroup&)> const& fn) {
+    std::lock_guard l{groupsMutex};
+    for (auto group : groups) {
+        fn(*group);
+    }
+}
+
+GeometryGroup::Stats GeometryGroup::stats() const { return {"unknown"}; }
+
+bool GeometryGroup::save(SnapshotWriter&) const { return false; }
+
+bool GeometryGroup::replace(GeoId, GeoId) { return false; }
+
+size_t GeometryGroup::clear() {
+    recipes->records.clear();
+    motions->entries.clear();
+    std::lock_guard l{spatial->mutex};
+    spatial->trees.clear();
+    spatial->entries.clear();
+    return 0;
+}
+
+std::vector<GeometryGroup::GeoId> GeometryGroup::queryIn(DimensionType dim, AABB const& box) const {
+    std::vector<GeoId> res;
+    std::lock_guard    l{spatial->mutex};
+    auto               it = spatial->trees.find((int)dim);
+    if (it == spatial->trees.end()) return res;
+    it->second.query(box, [&res](uint64 value, AABB const&) { res.push_back({value}); });
+    return res;
+}
+
+GeometryGroup::GeoId GeometryGroup::raycast(
+    DimensionType dim,
+    Vec3 const&   origin,
+    Vec3 const&   dir,
+    float         maxDist
+) const {
+    auto const length = dir.length();
+    if (length == 0) return GeoId::invalid();
+    std::lock_guard l{spatial->mutex};
+    auto            it = spatial->trees.find((int)dim);
+    if (it == spatial->trees.end()) return GeoId::invalid();
+    auto const unit = dir / length;
+    auto       hit  = it->second.raycast(origin, unit, maxDist, [&](uint64 value, float entry) {
+        return spatial->rayDistance(value, (int)dim, origin, unit, maxDist, entry);
+    });
+    return hit ? GeoId{hit->value} : GeoId::invalid();
+}
+
+GeometryGroup::GeoId GeometryGroup::nearest(DimensionType dim, Vec3 const& pos, float radius) const {
+    std::lock_guard l{spatial->mutex};
+    auto            it = spatial->trees.find((int)dim);
+    if (it == spatial->trees.end()) return GeoId::invalid();
+    auto hit = it->second.nearest(pos, radius, [&](uint64 value, float distance) {
+        return spatial->pointDistance(value, (int)dim, pos, distance);
+    });
+    return hit ? GeoId{hit->value} : GeoId::invalid();
+}
+
+size_t GeometryGroup::removeIn(DimensionType dim, AABB const& box) {
+    size_t res{};
+    for (auto& id : queryIn(dim, box)) {
+        if (remove(id)) ++res;
+    }
+    return res;
+}
+
+void GeometryGroup::setClearOnDestroy(bool value) { clearOnDestroy = value; }
+
+bool GeometryGroup::clearsOnDestroy() const { return clearOnDestroy; }
+
+bool GeometryGroup::patch(GeoId, GeoId) { return false; }
+
+bool GeometryGroup::update(GeoId id, std::function<GeoId(GeometryGroup&)> const& draw) {
+    if (id.value == 0) return false;
+    GeoId fresh;
+    {
+        StageScope stage;
+        fresh = draw(*this);
+    }
+    if (fresh.value == 0) return false;
+    if (!patch(id, fresh)) {
+        remove(fresh);
+        return false;
+    }
+    // 配方跟随新画出的图形
+    std::optional<RecipeBook::Record> record;
+    recipes->records.erase_if(fresh, [&record](auto&& iter) {
+        record = std::move(iter.second);
+        return true;
+    });
+    if (record) {
+        recipes->records.insert_or_assign(id, std::move(*record));
+    } else {
+        forget(id);
+    }
+    rebind(id, fresh);
+    return true;
+}
+
+GeometryGroup::GeoId GeometryGroup::remember(RecordScope const& scope, GeoId id, Recipe&& recipe) {
+    if (!scope.isOutermost() || id.value == 0) return id;
+    auto signature = RecipeBook::signatureOf(recipe);
+    recipes->records.insert_or_assign(id, RecipeBook::Record{std::move(recipe), signature});
+    return id;
+}
+
+void GeometryGroup::forget(GeoId id) {
+    recipes->records.erase(id);
+    motions->entries.erase(id);
+    std::lock_guard l{spatial->mutex};
+    spatial->take(id);
+}
+
+void GeometryGroup::moved(GeoId id, Vec3 const& offset) {
+    recipes->records.modify_if(id, [&offset](auto&& iter) { iter.second.offset += offset; });
+    std::lock_guard l{spatial->mutex};
+    spatial->put(id, spatial->take(id), offset);
+}
+
+void GeometryGroup::place(GeoId id, DimensionType dim, AABB const& bounds) {
+    if (id.value == 0) return;
+    std::lock_guard l{spatial->mutex};
+    spatial->place(id, (int)dim, bounds);
+}
+
+void GeometryGroup::place(
+    GeoId                    id,
+    DimensionType            dim,
+    std::span<LineSeg const> segments,
+    float                    radius
+) {
+    if (id.value == 0) return;
+    radius = std::max(radius, minPickRadius);
+    std::lock_guard l{spatial->mutex};
+    for (auto& [begin, end] : segments) spatial->place(id, {(int)dim, begin, end, radius});
+}
+
+void GeometryGroup::regroup(GeoId id, std::span<GeoId const> members) {
+    if (id.value == 0) return;
+    std::lock_guard l{spatial->mutex};
+    for (auto& member : members) spatial->put(id, spatial->take(member));
+}
+
+void GeometryGroup::rebind(GeoId target, GeoId source) {
+    std::lock_guard l{spatial->mutex};
+    spatial->take(target);
+    spatial->put(target, spatial->take(source));
+}
+
+Vec3 GeometryGroup::Motion::offsetAt(double seconds) const {
+    if (keyframes.empty()) return velocity * (float)seconds;
+    auto const duration = keyframes.back().time;
+    if (loop && duration > 0) seconds = std::fmod(seconds, duration);
+    if (seconds <= keyframes.front().time) return keyframes.front().offset;
+    if (seconds >= duration) return keyframes.back().offset;
+
+    auto next = std::upper_bound(
+        keyframes.begin(),
+        keyframes.end(),
+        seconds,
+        [](double time, Keyframe const& keyframe) { return time < keyframe.time; }
+    );
+    auto prev = next - 1;
+    auto t    = (float)((seconds - prev->time) / (next->time - prev->time));
+    switch (interpolation) {
+    case Interpolation::Step:
+        return prev->offset;
+    case Interpolation::Smooth:
+        t = t * t * (3 - 2 * t);
+        break;
+    case Interpolation::Linear:
+        break;
+    }
+    return prev->offset + (next->offset - prev->offset) * t;
+}
+
+bool GeometryGroup::Motion::finishedAt(double seconds) const {
+    return !keyframes.empty() && !loop && seconds >= keyframes.back().time;
+}
+
+bool GeometryGroup::setVisible(GeoId, bool) { return false; }
+
+bool GeometryGroup::setMotion(GeoId id, Motion const& motion) {
+    if (id.value == 0) return false;
+    if (motion.empty()) {
+        motions->entries.erase(id);
+        return true;
+    }
+    motions->entries.insert_or_assign(
+        id,
+        MotionBook::Entry{motion, std::chrono::steady_clock::now()}
+    );
+
+    return true;
+}
+
+// 所有组共用一个监听
+void GeometryGroup::startMotion() {
+    if (motionListener) return;
+    motionListener =
+        ll::event::EventBus::getInstance().emplaceListener<ll::event::world::ServerLevelTickEvent>(
+            [tick = size_t{}](ll::event::world::ServerLevelTickEvent&) mutable {
+                auto const interval = std::max<size_t>(
+                    1,
+                    BedrockServerClientInterface::getInstance().getConfig().motion.shiftInterval
+                );
+                if (++tick % interval != 0) return;
+                forEach([](GeometryGroup& group) { group.stepMotion(); });
+            }
+        );
+}
+
+void GeometryGroup::stopMotion() {
+    if (!motionListener) return;
+    ll::event::EventBus::getInstance().removeListener<ll::event::world::ServerLevelTickEvent>(
+        motionListener
+    );
+    motionListener.reset();
+}
+
+void GeometryGroup::stepMotion() {
+    auto const                          now = std::chrono::steady_clock::now();
+    std::vector<std::pair<GeoId, Vec3>> steps;
+    std::vector<GeoId>                  finished;
+    motions->entries.for_each_m([&](auto& iter) {
+        auto&      entry   = iter.second;
+        auto const seconds = std::chrono::duration<double>(now - entry.start).count();
+        auto const offset  = entry.motion.offsetAt(seconds);
+        if (!(offset == entry.applied)) {
+            steps.emplace_back(iter.first, offset - entry.applied);
+            entry.applied = offset;
+        }
+        if (entry.motion.finishedAt(seconds)) finished.push_back(iter.first);
+    });
+    for (auto& id : finished) motions->entries.erase(id);
+    for (auto& [id, offset] : steps) shift(id, offset);
+}
+
+size_t GeometryGroup::reload() {
+    std::vector<std::pair<GeoId, RecipeBook::Record>> stale;
+    recipes->records.for_each([&stale](auto const& iter) {
+        if (RecipeBook::signatureOf(iter.second.recipe) != iter.second.signature) {
+            stale.emplace_back(iter);
+        }
+    });
+
+    size_t res{};
+    for (auto& [id, record] : stale) {
+        GeoId fresh;
+        {
+            RecordScope scope; // 新细分出的图形不单独记录
+            fresh = record.recipe.draw(*this, record.offset);
+        }
+        if (fresh.value == 0) continue;
+        if (!replace(id, fresh)) {
+            remove(fresh);
+            continue;
+        }
+        rebind(id, fresh);
+        recipes->records.modify_if(id, [](auto&& iter) {
+            iter.second.signature = RecipeBook::signatureOf(iter.second.recipe);
+        });
+        ++res;
+    }
+    return res;
+}
+
+GeometryGroup::Recipe GeometryGroup::circleRecipe(
+    DimensionType        dim,
+    Vec3 const&          center,
+    Vec3 const&          normal,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return {RecipeKind::Circle, radius, 0, [=](GeometryGroup& group, Vec3 const& offset) {
+                return group.circle(dim, center + offset, normal, radius, color, thickness);
+            }};
+}
+
+GeometryGroup::Recipe GeometryGroup::cylinderRecipe(
+    DimensionType        dim,
+    Vec3 const&          topCenter,
+    Vec3 const&          bottomCenter,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return {RecipeKind::Cylinder, radius, 0, [=](GeometryGroup& group, Vec3 const& offset) {
+                return group.cylinder(
+                    dim,
+                    topCenter + offset,
+                    bottomCenter + offset,
+                    radius,
+                    color,
+                    thickness
+                );
+            }};
+}
+
+GeometryGroup::Recipe GeometryGroup::sphereRecipe(
+    DimensionType        dim,
+    Vec3 const&          center,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return {RecipeKind::Sphere, radius, 0, [=](GeometryGroup& group, Vec3 const& offset) {
+                return group.sphere(dim, center + offset, radius, color, thickness);
+            }};
+}
+
+GeometryGroup::Recipe GeometryGroup::arrowRecipe(
+    DimensionType        dim,
+    Vec3 const&          begin,
+    Vec3 const&          end,
+    mce::Color const&    color,
+    std::optional<float> mArrowHeadLength,
+    std::optional<float> mArrowHeadRadius
+) {
+    return {RecipeKind::Arrow, 0, 0, [=](GeometryGroup& group, Vec3 const& offset) {
+                return group.arrow(
+                    dim,
+                    begin + offset,
+                    end + offset,
+                    color,
+                    mArrowHeadLength,
+                    mArrowHeadRadius
+                );
+            }};
+}
+
+bool GeometryGroup::load(SnapshotReader&) { return false; }
+
+std::shared_ptr<GeometryGroup> GeometryGroup::getPersistent(std::string const& name) {
+    return snapshot::get(name);
+}
+
+bool GeometryGroup::removePersistent(std::string const& name) { return snapshot::drop(name); }
+
 std::unique_ptr<GeometryGroup> GeometryGroup::createDefault() {
     auto& type = BedrockServerClientInterface::getInstance().getConfig().defaultGroup;
     if (type == "particle") {
@@ -21,9 +586,43 @@ std::unique_ptr<GeometryGroup> GeometryGroup::createDefault() {
     }
 }
 
-GeometryGroup::GeoId GeometryGroup::getNextGeoId() const {
-    static std::atomic_uint64_t id{};
-    return {++id};
+std::unique_ptr<GeometryGroup>
+GeometryGroup::createForViewers(std::shared_ptr<ViewerSet> viewers) {
+    auto& config = BedrockServerClientInterface::getInstance().getConfig();
+    if (config.defaultGroup == "particle") {
+        return std::make_unique<ParticleSpawner>(config.particle.persistent, std::move(viewers));
+    } else {
+        return std::make_unique<DebugDrawingHandler>(std::move(viewers));
+    }
+}
+
+std::unique_ptr<GeometryGroup> GeometryGroup::createShared() {
+    return std::make_unique<SharedGeometryGroup>();
+}
+
+static std::atomic_uint64_t nextGeoId{};
+
+GeometryGroup::GeoId GeometryGroup::getNextGeoId() const { return {++nextGeoId}; }
+
+void GeometryGroup::reserveGeoIds(GeoId last) {
+    auto current = nextGeoId.load();
+    while (current < last.value && !nextGeoId.compare_exchange_weak(current, last.value)) {}
+}
+size_t GeometryGroup::sphereCells(float radius) {
+    auto const& config = BedrockServerClientInterface::getInstance().getConfig().particle;
+    return std::clamp(
+        (size_t)std::ceil(radius * 2 / config.minSphereSpacing),
+        2ui64,
+        config.maxSphereCells
+    );
+}
+size_t GeometryGroup::circleSegments(float radius) {
+    auto const& config = BedrockServerClientInterface::getInstance().getConfig().particle;
+    return std::clamp(
+        (size_t)std::ceil(radius * std::numbers::pi * 2 / config.minCircleSpacing),
+        7ui64,
+        config.maxCircleSegments
+    );
 }
 GeometryGroup::GeoId GeometryGroup::point(
     DimensionType        dim,
@@ -39,13 +638,27 @@ GeometryGroup::GeoId GeometryGroup::line(
     std::span<Vec3>      dots,
     mce::Color const&    color,
     std::optional<float> thickness
+) {
+    if (dots.size() < 2) return GeoId::invalid();
+    std::vector<LineSeg> segments;
+    segments.reserve(dots.size() - 1);
+    for (auto [begin, end] : dots | std::views::pairwise) segments.emplace_back(begin, end);
+    return emitLines(dim, segments, color, thickness);
+}
+GeometryGroup::GeoId GeometryGroup::emitLines(
+    DimensionType            dim,
+    std::span<LineSeg const> segments,
+    mce::Color const&        color,
+    std::optional<float>     thickness
 ) {
     std::vector<GeoId> ids;
-    ids.reserve(dots.size() - 1);
-    for (auto [begin, end] : dots | std::views::pairwise) {
+    ids.reserve(segments.size());
+    for (auto& [begin, end] : segments) {
+        if (begin == end) continue;
         ids.emplace_back(line(dim, begin, end, color, thickness));
     }
-    return merge(ids);
+    if (ids.empty()) return GeoId::invalid();
+    return ids.size() == 1 ? ids.front() : merge(ids);
 }
 GeometryGroup::GeoId GeometryGroup::box(
     DimensionType        dim,
@@ -54,24 +667,24 @@ GeometryGroup::GeoId GeometryGroup::box(
     std::optional<float> thickness
 ) {
     // clang-format off
-    auto ids = std::array{
-        line(dim, {box.min.x, box.min.y, box.min.z}, {box.min.x, box.min.y, box.max.z}, color, thickness),
-        line(dim, {box.max.x, box.min.y, box.min.z}, {box.max.x, box.min.y, box.max.z}, color, thickness),
-        line(dim, {box.min.x, box.max.y, box.min.z}, {box.min.x, box.max.y, box.max.z}, color, thickness),
-        line(dim, {box.max.x, box.max.y, box.min.z}, {box.max.x, box.max.y, box.max.z}, color, thickness),
-
-        line(dim, {box.min.x, box.min.y, box.min.z}, {box.min.x, box.max.y, box.min.z}, color, thickness),
-        line(dim, {box.max.x, box.min.y, box.min.z}, {box.max.x, box.max.y, box.min.z}, color, thickness),
-        line(dim, {box.min.x, box.min.y, box.max.z}, {box.min.x, box.max.y, box.max.z}, color, thickness),
-        line(dim, {box.max.x, box.min.y, box.max.z}, {box.max.x, box.max.y, box.max.z}, color, thickness),
-
-        line(dim, {box.min.x, box.min.y, box.min.z}, {box.max.x, box.min.y, box.min.z}, color, thickness),
-        line(dim, {box.min.x, box.max.y, box.min.z}, {box.max.x, box.max.y, box.min.z}, color, thickness),
-        line(dim, {box.min.x, box.min.y, box.max.z}, {box.max.x, box.min.y, box.max.z}, color, thickness),
-        line(dim, {box.min.x, box.max.y, box.max.z}, {box.max.x, box.max.y, box.max.z}, color, thickness),
+    auto const segments = std::array{
+        LineSeg{{box.min.x, box.min.y, box.min.z}, {box.min.x, box.min.y, box.max.z}},
+        LineSeg{{box.max.x, box.min.y, box.min.z}, {box.max.x, box.min.y, box.max.z}},
+        LineSeg{{box.min.x, box.max.y, box.min.z}, {box.min.x, box.max.y, box.max.z}},
+        LineSeg{{box.max.x, box.max.y, box.min.z}, {box.max.x, box.max.y, box.max.z}},
+
+        LineSeg{{box.min.x, box.min.y, box.min.z}, {box.min.x, box.max.y, box.min.z}},
+        LineSeg{{box.max.x, box.min.y, box.min.z}, {box.max.x, box.max.y, box.min.z}},
+        LineSeg{{box.min.x, box.min.y, box.max.z}, {box.min.x, box.max.y, box.max.z}},
+        LineSeg{{box.max.x, box.min.y, box.max.z}, {box.max.x, box.max.y, box.max.z}},
+
+        LineSeg{{box.min.x, box.min.y, box.min.z}, {box.max.x, box.min.y, box.min.z}},
+        LineSeg{{box.min.x, box.max.y, box.min.z}, {box.max.x, box.max.y, box.min.z}},
+        LineSeg{{box.min.x, box.min.y, box.max.z}, {box.max.x, box.min.y, box.max.z}},
+        LineSeg{{box.min.x, box.max.y, box.max.z}, {box.max.x, box.max.y, box.max.z}},
     };
     // clang-format on
-    return merge(ids);
+    return emitLines(dim, segments, color, thickness);
 }
 GeometryGroup::GeoId GeometryGroup::circle(
     DimensionType        dim,
@@ -81,27 +694,25 @@ GeometryGroup::GeoId GeometryGroup::circle(
     mce::Color const&    color,
     std::optional<float> thickness
 ) {
-    auto const& config = BedrockServerClientInterface::getInstance().getConfig().particle;
-
-    size_t const points = std::clamp(
-        (size_t)std::ceil(radius * std::numbers::pi * 2 / config.minCircleSpacing),
-        7ui64,
-        config.maxCircleSegments
-
-    );
+    RecordScope       scope;
+    size_t const      points = circleSegments(radius);
     auto const [t, b] = branchlessONB(normal);
     auto const delta  = std::numbers::pi * 2 / (double)points;
 
-    std::vector<GeoId> ids;
-    ids.reserve(points);
+    std::vector<LineSeg> segments;
+    segments.reserve(points);
     Vec3 lastPos = t * radius;
     for (size_t i{1}; i <= points; i++) {
         double theta = (double)i * delta;
         Vec3   pos   = t * (radius * std::cos(theta)) + b * radius * std::sin(theta);
-        ids.emplace_back(line(dim, center + lastPos, center + pos, color, thickness));
+        segments.emplace_back(center + lastPos, center + pos);
         lastPos = pos;
     }
-    return merge(ids);
+    return remember(
+        scope,
+        emitLines(dim, segments, color, thickness),
+        circleRecipe(dim, center, normal, radius, color, thickness)
+    );
 }
 GeometryGroup::GeoId GeometryGroup::cylinder(
     DimensionType        dim,
@@ -111,29 +722,27 @@ GeometryGroup::GeoId GeometryGroup::cylinder(
     mce::Color const&    color,
     std::optional<float> thickness
 ) {
-    auto const& config = BedrockServerClientInterface::getInstance().getConfig().particle;
-
-    size_t const points = std::clamp(
-        (size_t)std::ceil(radius * std::numbers::pi * 2 / config.minCircleSpacing),
-        7ui64,
-        config.maxCircleSegments
-
-    );
+    RecordScope       scope;
+    size_t const      points = circleSegments(radius);
     auto const [t, b] = branchlessONB((topCenter - bottomCenter).normalize());
     auto const delta  = std::numbers::pi * 2 / (double)points;
 
-    std::vector<GeoId> ids;
-    ids.reserve(3 * points);
+    std::vector<LineSeg> segments;
+    segments.reserve(3 * points);
     Vec3 lastPos = t * radius;
     for (size_t i{1}; i <= points; i++) {
         double theta = (double)i * delta;
         Vec3   pos   = t * (radius * std::cos(theta)) + b * radius * std::sin(theta);
-        ids.emplace_back(line(dim, topCenter + lastPos, topCenter + pos, color, thickness));
-        ids.emplace_back(line(dim, topCenter + pos, bottomCenter + pos, color, thickness));
-        ids.emplace_back(line(dim, bottomCenter + lastPos, bottomCenter + pos, color, thickness));
+        segments.emplace_back(topCenter + lastPos, topCenter + pos);
+        segments.emplace_back(topCenter + pos, bottomCenter + pos);
+        segments.emplace_back(bottomCenter + lastPos, bottomCenter + pos);
         lastPos = pos;
     }
-    return merge(ids);
+    return remember(
+        scope,
+        emitLines(dim, segments, color, thickness),
+        cylinderRecipe(dim, topCenter, bottomCenter, radius, color, thickness)
+    );
 }
 
 static Vec3 cubeToSphere(Vec3 const& v) {
@@ -153,13 +762,8 @@ GeometryGroup::GeoId GeometryGroup::sphere(
     mce::Color const&    color,
     std::optional<float> thickness
 ) {
-    auto const& config = BedrockServerClientInterface::getInstance().getConfig().particle;
-
-    size_t const cells = std::clamp(
-        (size_t)std::ceil(radius * 2 / config.minSphereSpacing),
-        2ui64,
-        config.maxSphereCells
-    );
+    RecordScope  scope;
+    size_t const cells = sphereCells(radius);
     auto lines = std::vector{
         std::pair{Vec3{-1, -1, -1}, Vec3{-1, -1, +1}},
         std::pair{Vec3{+1, -1, -1}, Vec3{+1, -1, +1}},
@@ -194,19 +798,23 @@ GeometryGroup::GeoId GeometryGroup::sphere(
         lines.emplace_back(Vec3{-1, -1, p}, Vec3{+1, -1, p});
         lines.emplace_back(Vec3{-1, +1, p}, Vec3{+1, +1, p});
     }
-    std::vector<GeoId> ids;
-    ids.reserve(lines.size() * cells);
+    std::vector<LineSeg> segments;
+    segments.reserve(lines.size() * cells);
 
     for (auto const& [begin, end] : lines) {
         Vec3 lastPos = center + cubeToSphere(begin) * radius;
         for (size_t i = 1; i <= cells; i++) {
             Vec3 pos = lerp(begin, end, {(float)i / (float)cells});
             pos      = center + cubeToSphere(pos) * radius;
-            ids.emplace_back(line(dim, lastPos, pos, color, thickness));
+            segments.emplace_back(lastPos, pos);
             lastPos = pos;
         }
     }
-    return merge(ids);
+    return remember(
+        scope,
+        emitLines(dim, segments, color, thickness),
+        sphereRecipe(dim, center, radius, color, thickness)
+    );
 }
 
 GeometryGroup::GeoId GeometryGroup::
@@ -219,6 +827,286 @@ GeometryGroup::GeoId GeometryGroup::
     return GeoId::invalid();
 }
 
+// 标签相同的相邻格子合并成的长方体，范围为[begin, end)
+struct Cuboid {
+    BlockPos begin;
+    BlockPos end;
+    uint32   label;
+};
+
+// 贪心合并：依次沿x、z、y方向尽量延伸，标签0为空格子，合并过的格子会被清零
+static std::vector<Cuboid> greedyMesh(std::vector<uint32>& labels, BlockPos const& size) {
+    auto const at = [&](int x, int y, int z) -> uint32& {
+        return labels[((size_t)y * size.z + z) * size.x + x];
+    };
+    auto const rowIs = [&](int x0, int x1, int y, int z, uint32 label) {
+        for (int x = x0; x < x1; x++) {
+            if (at(x, y, z) != label) return false;
+        }
+        return true;
+    };
+
+    std::vector<Cuboid> res;
+    for (int y = 0; y < size.y; y++) {
+        for (int z = 0; z < size.z; z++) {
+            for (int x = 0; x < size.x; x++) {
+                auto const label = at(x, y, z);
+                if (label == 0) continue;
+                int x1 = x + 1;
+                while (x1 < size.x && at(x1, y, z) == label) ++x1;
+                int z1 = z + 1;
+                while (z1 < size.z && rowIs(x, x1, y, z1, label)) ++z1;
+                int  y1    = y + 1;
+                auto layer = [&](int yy) {
+                    for (int zz = z; zz < z1; zz++) {
+                        if (!rowIs(x, x1, yy, zz, label)) return false;
+                    }
+                    return true;
+                };
+                while (y1 < size.y && layer(y1)) ++y1;
+
+                for (int yy = y; yy < y1; yy++) {
+                    for (int zz = z; zz < z1; zz++) {
+                        for (int xx = x; xx < x1; xx++) at(xx, yy, zz) = 0;
+                    }
+                }
+                res.emplace_back(BlockPos{x, y, z}, BlockPos{x1, y1, z1}, label);
+            }
+        }
+    }
+    return res;
+}
+
+// labels中的标签n对应colors[n - 1]
+static GeometryGroup::GeoId drawCells(
+    GeometryGroup&              group,
+    DimensionType               dim,
+    BlockPos const&             origin,
+    BlockPos const&             size,
+    std::vector<uint32>&&       labels,
+    std::span<mce::Color const> colors,
+    std::optional<float>        thickness
+) {
+    std::vector<GeometryGroup::GeoId> ids;
+    for (auto& cuboid : greedyMesh(labels, size)) {
+        AABB const box{Vec3{origin + cuboid.begin}, Vec3{origin + cuboid.end}};
+        ids.emplace_back(group.box(dim, box, colors[cuboid.label - 1], thickness));
+    }
+    return group.merge(ids);
+}
+
+static size_t cellCount(BlockPos const& size) {
+    if (size.x <= 0 || size.y <= 0 || size.z <= 0) return 0;
+    return (size_t)size.x * size.y * size.z;
+}
+
+GeometryGroup::GeoId GeometryGroup::heatmap(
+    DimensionType          dim,
+    BlockPos const&        origin,
+    BlockPos const&        size,
+    std::span<float const> values,
+    Palette const&         palette,
+    std::optional<float>   thickness
+) {
+    auto const count = cellCount(size);
+    if (count == 0 || values.size() < count || palette.colors.empty()) return GeoId::invalid();
+
+    auto const bins  = (float)palette.colors.size();
+    auto const range = palette.max - palette.min;
+
+    std::vector<uint32> labels(count);
+    for (size_t i = 0; i < count; i++) {
+        if (std::isnan(values[i])) continue;
+        auto const t = range > 0 ? (values[i] - palette.min) / range : 0.0f;
+        labels[i]    = (uint32)std::clamp(std::floor(t * bins), 0.0f, bins - 1) + 1;
+    }
+    return drawCells(*this, dim, origin, size, std::move(labels), palette.colors, thickness);
+}
+
+GeometryGroup::GeoId GeometryGroup::heatmap(
+    DimensionType               dim,
+    BlockPos const&             origin,
+    BlockPos const&             size,
+    std::span<mce::Color const> colors,
+    std::optional<float>        thickness
+) {
+    auto const count = cellCount(size);
+    if (count == 0 || colors.size() < count) return GeoId::invalid();
+
+    // 相同的颜色共用一个标签
+    std::vector<mce::Color>                table;
+    std::map<std::array<float, 4>, uint32> index;
+    std::vector<uint32>                    labels(count);
+    for (size_t i = 0; i < count; i++) {
+        auto& c = colors[i];
+        if (c.a <= 0) continue;
+        auto [it, inserted] = index.try_emplace({c.r, c.g, c.b, c.a}, (uint32)table.size() + 1);
+        if (inserted) table.push_back(c);
+        labels[i] = it->second;
+    }
+    return drawCells(*this, dim, origin, size, std::move(labels), table, thickness);
+}
+
+// 曲线与连接首尾的匀速直线之间的最大偏差不超过该值
+static float flatness(Vec3 const& p0, Vec3 const& p1, Vec3 const& p2, Vec3 const& p3) {
+    auto const a = p1 - (p0 * 2.0f + p3) * (1.0f / 3);
+    auto const b = p2 - (p0 + p3 * 2.0f) * (1.0f / 3);
+    return 0.75f * std::max(a.length(), b.length());
+}
+
+// 递归二分直到足够平直，把每段的终点追加到out
+static void flatten(
+    Vec3 const&        p0,
+    Vec3 const&        p1,
+    Vec3 const&        p2,
+    Vec3 const&        p3,
+    float              tolerance,
+    size_t             depth,
+    std::vector<Vec3>& out
+) {
+    if (depth == 0 || flatness(p0, p1, p2, p3) <= tolerance) {
+        out.push_back(p3);
+        return;
+    }
+    auto const p01  = (p0 + p1) * 0.5f;
+    auto const p12  = (p1 + p2) * 0.5f;
+    auto const p23  = (p2 + p3) * 0.5f;
+    auto const p012 = (p01 + p12) * 0.5f;
+    auto const p123 = (p12 + p23) * 0.5f;
+    auto const mid  = (p012 + p123) * 0.5f;
+    flatten(p0, p01, p012, mid, tolerance, depth - 1, out);
+    flatten(mid, p123, p23, p3, tolerance, depth - 1, out);
+}
+
+static void
+flatten(Vec3 const& p0, Vec3 const& p1, Vec3 const& p2, Vec3 const& p3, std::vector<Vec3>& out) {
+    auto const& config = BedrockServerClientInterface::getInstance().getConfig().particle;
+    auto const  depth  = (size_t)std::bit_width(std::max<size_t>(config.maxCurveSegments, 1)) - 1;
+    flatten(p0, p1, p2, p3, std::max((float)config.curveTolerance, 1e-4f), depth, out);
+}
+
+GeometryGroup::GeoId GeometryGroup::bezier(
+    DimensionType        dim,
+    Vec3 const&          p0,
+    Vec3 const&          p1,
+    Vec3 const&          p2,
+    Vec3 const&          p3,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    RecordScope       scope;
+    std::vector<Vec3> dots{p0};
+    flatten(p0, p1, p2, p3, dots);
+    Recipe recipe{
+        RecipeKind::Curve,
+        0,
+        0,
+        [=](GeometryGroup& group, Vec3 const& offset) {
+            return group
+                .bezier(dim, p0 + offset, p1 + offset, p2 + offset, p3 + offset, color, thickness);
+        }
+    };
+    return remember(scope, line(dim, dots, color, thickness), std::move(recipe));
+}
+
+GeometryGroup::GeoId GeometryGroup::spline(
+    DimensionType         dim,
+    std::span<Vec3 const> dots,
+    mce::Color const&     color,
+    std::optional<float>  thickness
+) {
+    if (dots.size() < 2) return GeoId::invalid();
+    RecordScope       scope;
+    std::vector<Vec3> res{dots.front()};
+    // 均匀Catmull-Rom，首尾各补一个重复的控制点
+    for (size_t i = 0; i + 1 < dots.size(); i++) {
+        auto const& prev = dots[i == 0 ? 0 : i - 1];
+        auto const& from = dots[i];
+        auto const& to   = dots[i + 1];
+        auto const& next = dots[std::min(i + 2, dots.size() - 1)];
+        flatten(from, from + (to - prev) * (1.0f / 6), to - (next - from) * (1.0f / 6), to, res);
+    }
+    Recipe recipe{
+        RecipeKind::Curve,
+        0,
+        0,
+        [=, dots = std::vector<Vec3>(dots.begin(), dots.end())](
+            GeometryGroup& group,
+            Vec3 const&    offset
+        ) {
+            auto moved = dots;
+            for (auto& dot : moved) dot += offset;
+            return group.spline(dim, moved, color, thickness);
+        }
+    };
+    return remember(scope, line(dim, res, color, thickness), std::move(recipe));
+}
+
+std::vector<GeometryGroup::Sample> GeometryGroup::decimate(
+    std::span<Vec3 const>       points,
+    std::span<mce::Color const> colors,
+    std::optional<float>        cellSize
+) {
+    auto const colorOf = [&colors](size_t i) {
+        if (colors.empty()) return mce::Color::WHITE();
+        return colors[std::min(i, colors.size() - 1)];
+    };
+
+    std::vector<Sample> res;
+    if (!cellSize || *cellSize <= 0) {
+        res.reserve(points.size());
+        for (size_t i = 0; i < points.size(); i++) res.emplace_back(points[i], colorOf(i));
+        return res;
+    }
+
+    struct Cell {
+        int64 x, y, z;
+        bool  operator==(Cell const&) const = default;
+    };
+    struct CellHash {
+        size_t operator()(Cell const& c) const {
+            return std::hash<int64>{}(c.x * 73856093 ^ c.y * 19349663 ^ c.z * 83492791);
+        }
+    };
+    std::unordered_map<Cell, size_t, CellHash> cells;
+    std::vector<size_t>                         counts;
+
+    auto const inv = 1.0f / *cellSize;
+    for (size_t i = 0; i < points.size(); i++) {
+        auto const& p = points[i];
+        Cell const  cell{
+            (int64)std::floor(p.x * inv),
+            (int64)std::floor(p.y * inv),
+            (int64)std::floor(p.z * inv)
+        };
+        auto [it, inserted] = cells.try_emplace(cell, res.size());
+        if (inserted) {
+            res.emplace_back(p, colorOf(i));
+            counts.push_back(1);
+            continue;
+        }
+        // 增量求平均，不需要再遍历一次
+        auto& sample = res[it->second];
+        auto  n      = (float)++counts[it->second];
+        sample.pos   = sample.pos + (p - sample.pos) * (1.0f / n);
+    }
+    return res;
+}
+
+GeometryGroup::GeoId GeometryGroup::points(
+    DimensionType               dim,
+    std::span<Vec3 const>       points,
+    std::span<mce::Color const> colors,
+    std::optional<float>        radius,
+    std::optional<float>        cellSize
+) {
+    auto const         samples = decimate(points, colors, cellSize);
+    std::vector<GeoId> ids;
+    ids.reserve(samples.size());
+    for (auto& sample : samples) ids.emplace_back(point(dim, sample.pos, sample.color, radius));
+    return merge(ids);
+}
+
 GeometryGroup::GeoId GeometryGroup::cone(
     DimensionType        dim,
     Vec3 const&          topCenter,
@@ -228,27 +1116,13 @@ GeometryGroup::GeoId GeometryGroup::cone(
     mce::Color const&    color,
     std::optional<float> thickness
 ) {
-    auto const& config = BedrockServerClientInterface::getInstance().getConfig().particle;
-
-    size_t const points =
-        (std::clamp(
-             (size_t)std::ceil(topRadius * std::numbers::pi * 2 / config.minCircleSpacing),
-             7ui64,
-             config.maxCircleSegments
-
-         )
-         + std::clamp(
-             (size_t)std::ceil(bottomRadius * std::numbers::pi * 2 / config.minCircleSpacing),
-             7ui64,
-             config.maxCircleSegments
-
-         ))
-        / 2;
+    RecordScope  scope;
+    size_t const points = (circleSegments(topRadius) + circleSegments(bottomRadius)) / 2;
     auto const [t, b] = branchlessONB((topCenter - bottomCenter).normalize());
     auto const delta  = std::numbers::pi * 2 / (double)points;
 
-    std::vector<GeoId> ids;
-    ids.reserve(3 * points);
+    std::vector<LineSeg> segments;
+    segments.reserve(3 * points);
     Vec3 lastTopOffset    = t * topRadius;
     Vec3 lastBottomOffset = t * bottomRadius;
     for (size_t i{1}; i <= points; i++) {
@@ -256,22 +1130,28 @@ GeometryGroup::GeoId GeometryGroup::cone(
         Vec3   topOffset = t * (topRadius * std::cos(theta)) + b * topRadius * std::sin(theta);
         Vec3   bottomOffset =
             t * (bottomRadius * std::cos(theta)) + b * bottomRadius * std::sin(theta);
-        ids.emplace_back(
-            line(dim, topCenter + lastTopOffset, topCenter + topOffset, color, thickness)
-        );
-        ids.emplace_back(
-            line(dim, topCenter + topOffset, bottomCenter + bottomOffset, color, thickness)
-        );
-        ids.emplace_back(line(
-            dim,
-            bottomCenter + lastBottomOffset,
-            bottomCenter + bottomOffset,
-            color,
-            thickness
-        ));
+        segments.emplace_back(topCenter + lastTopOffset, topCenter + topOffset);
+        segments.emplace_back(topCenter + topOffset, bottomCenter + bottomOffset);
+        segments.emplace_back(bottomCenter + lastBottomOffset, bottomCenter + bottomOffset);
         lastTopOffset    = topOffset;
         lastBottomOffset = bottomOffset;
     }
-    return merge(ids);
+    Recipe recipe{
+        RecipeKind::Cone,
+        topRadius,
+        bottomRadius,
+        [=](GeometryGroup& group, Vec3 const& offset) {
+            return group.cone(
+                dim,
+                topCenter + offset,
+                bottomCenter + offset,
+                topRadius,
+                bottomRadius,
+                color,
+                thickness
+            );
+        }
+    };
+    return remember(scope, emitLines(dim, segments, color, thickness), std::move(recipe));
 }
 } // namespace bsci
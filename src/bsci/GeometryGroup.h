@@ -3,10 +3,22 @@
 #include "bsci/Marcos.h"
 #include "mc/world/phys/AABB.h"
 
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include <mc/deps/core/math/Color.h>
 #include <mc/deps/core/utility/AutomaticID.h>
+#include <mc/world/level/BlockPos.h>
 
 namespace bsci {
+class SnapshotWriter;
+class SnapshotReader;
+class ViewerSet;
+
 class GeometryGroup {
 public:
     struct GeoId {
@@ -17,13 +29,177 @@ class GeometryGroup {
         static constexpr GeoId invalid() { return GeoId{0}; }
     };
 
+    struct Stats {
+        std::string_view backend;
+        size_t           geoIds{};
+        size_t           primitives{};
+        size_t           chunkIndexSize{};
+    };
+
+    struct LineSeg {
+        Vec3 begin;
+        Vec3 end;
+    };
+
 protected:
     BSCI_API GeoId getNextGeoId() const;
 
+    // 从快照恢复后调用，保证之后分配的GeoId不会与恢复的重复
+    BSCI_API static void reserveGeoIds(GeoId last);
+
+    BSCI_API static size_t circleSegments(float radius);
+
+    BSCI_API static size_t sphereCells(float radius);
+
+    enum class RecipeKind { Circle, Cylinder, Cone, Sphere, Arrow, Curve };
+
+    // 细分结果与配置相关的图形记下调用方式，配置重载后据此重新细分
+    struct Recipe {
+        RecipeKind kind;
+        float      radius{};  // 决定细分段数的半径
+        float      radius2{}; // 仅圆台使用
+        std::function<GeoId(GeometryGroup&, Vec3 const& offset)> draw;
+    };
+
+    // 嵌套调用时只记录最外层，例如cylinder内部调用的circle
+    class RecordScope {
+        bool outermost;
+
+    public:
+        BSCI_API RecordScope();
+        BSCI_API ~RecordScope();
+
+        bool isOutermost() const { return outermost; }
+    };
+
+    BSCI_API static Recipe circleRecipe(
+        DimensionType        dim,
+        Vec3 const&          center,
+        Vec3 const&          normal,
+        float                radius,
+        mce::Color const&    color,
+        std::optional<float> thickness
+    );
+
+    BSCI_API static Recipe cylinderRecipe(
+        DimensionType        dim,
+        Vec3 const&          topCenter,
+        Vec3 const&          bottomCenter,
+        float                radius,
+        mce::Color const&    color,
+        std::optional<float> thickness
+    );
+
+    BSCI_API static Recipe sphereRecipe(
+        DimensionType        dim,
+        Vec3 const&          center,
+        float                radius,
+        mce::Color const&    color,
+        std::optional<float> thickness
+    );
+
+    BSCI_API static Recipe arrowRecipe(
+        DimensionType        dim,
+        Vec3 const&          begin,
+        Vec3 const&          end,
+        mce::Color const&    color,
+        std::optional<float> mArrowHeadLength,
+        std::optional<float> mArrowHeadRadius
+    );
+
+    // 返回id本身，方便直接写在return语句中
+    BSCI_API GeoId remember(RecordScope const& scope, GeoId id, Recipe&& recipe);
+
+    // 后端在remove、merge时调用
+    BSCI_API void forget(GeoId id);
+
+    // 后端在shift时调用
+    BSCI_API void moved(GeoId id, Vec3 const& offset);
+
+    // 后端创建图元时登记其包围盒，同一id多次登记时取并集
+    BSCI_API void place(GeoId id, DimensionType dim, AABB const& bounds);
+
+    // 登记线段外扩radius得到的胶囊体，raycast、nearest据此精确判断；点用首尾相同的线段
+    // 只用包围盒登记过的GeoId仍按包围盒判断
+    BSCI_API void
+    place(GeoId id, DimensionType dim, std::span<LineSeg const> segments, float radius);
+
+    // 后端在merge时调用，把members的包围盒并到id名下
+    BSCI_API void regroup(GeoId id, std::span<GeoId const> members);
+
+    struct Sample {
+        Vec3       pos;
+        mce::Color color;
+    };
+
+    // 按边长为cellSize的体素网格合并点，每格取平均位置和第一个点的颜色，不给cellSize时不合并
+    // colors为空时为白色，数量不足时其余的点使用最后一个颜色
+    BSCI_API static std::vector<Sample> decimate(
+        std::span<Vec3 const>       points,
+        std::span<mce::Color const> colors,
+        std::optional<float>        cellSize
+    );
+
+    // update期间画出的图形先不发送，由patch决定补发哪些
+    class StageScope {
+    public:
+        BSCI_API StageScope();
+        BSCI_API ~StageScope();
+    };
+
+    BSCI_API static bool isStaging();
+
+    // 后端在析构时检查，为true时先clear
+    BSCI_API bool clearsOnDestroy() const;
+
+    // 派生类在析构函数开头调用，返回后forEach不会再访问到这个对象；
+    // 基类析构时才移除的话，其他线程的forEach可能调用到已析构一半的对象；可重复调用
+    BSCI_API void delist();
+
+private:
+    bool clearOnDestroy{};
+
+    struct RecipeBook;
+    std::unique_ptr<RecipeBook> recipes;
+
+    struct MotionBook;
+    std::unique_ptr<MotionBook> motions;
+
+    struct SpatialBook;
+    std::unique_ptr<SpatialBook> spatial;
+
+    // target的包围盒换成source的
+    void rebind(GeoId target, GeoId source);
+
+    void stepMotion();
+
 public:
     BSCI_API static std::unique_ptr<GeometryGroup> createDefault();
 
-    BSCI_API virtual ~GeometryGroup() = default;
+    // 与其他共享组按内容去重后共用同一个后端，见SharedGeometryGroup
+    BSCI_API static std::unique_ptr<GeometryGroup> createShared();
+
+    // 与createDefault相同，但发送、补发和移除都只针对viewers中的玩家，集合可随时增减
+    BSCI_API static std::unique_ptr<GeometryGroup>
+    createForViewers(std::shared_ptr<ViewerSet> viewers);
+
+    // 获取具名的持久图形组，模组关闭时写入快照，重新启用后连同GeoId一起恢复
+    BSCI_API static std::shared_ptr<GeometryGroup> getPersistent(std::string const& name);
+
+    // 销毁具名的持久图形组并删除其快照
+    BSCI_API static bool removePersistent(std::string const& name);
+
+    // 遍历当前存活的所有GeometryGroup
+    BSCI_API static void forEach(std::function<void(GeometryGroup&)> const& fn);
+
+    // 插件enable时注册、disable时移除推进所有组运动的tick监听
+    static void startMotion();
+
+    static void stopMotion();
+
+    BSCI_API GeometryGroup();
+
+    BSCI_API virtual ~GeometryGroup();
 
     BSCI_API virtual GeoId point(
         DimensionType        dim,
@@ -111,6 +287,144 @@ class GeometryGroup {
         mce::Color const&    color     = mce::Color::WHITE(),
         std::optional<float> thickness = {}
     );
+
+    // 以下虚函数为后来加入，新增的只能追加在末尾，以免已有虚函数在虚表中的位置变化，
+    // 使按旧头文件编译的依赖模组失效
+
+    BSCI_API virtual Stats stats() const;
+
+    // 写入后端保存的图元，不支持快照的后端返回false
+    BSCI_API virtual bool save(SnapshotWriter& writer) const;
+
+    BSCI_API virtual bool load(SnapshotReader& reader);
+
+    // 配置重载后调用，只重新细分受影响的图形，返回重新细分的数量
+    BSCI_API virtual size_t reload();
+
+    // 一次移除全部图形，客户端的移除合并成少量包发送，返回移除的图元数量
+    BSCI_API virtual size_t clear();
+
+    // 开启后析构时自动clear，默认关闭，析构后图形仍留在客户端
+    BSCI_API void setClearOnDestroy(bool value);
+
+    // 返回包围盒与box相交的GeoId，由每个维度一棵AABB树加速，耗时只与结果数量有关
+    // 客户端自行移动的粒子按setMotion时的位置计算
+    BSCI_API virtual std::vector<GeoId> queryIn(DimensionType dim, AABB const& box) const;
+
+    // 移除queryIn得到的所有图形，返回移除的数量
+    BSCI_API virtual size_t removeIn(DimensionType dim, AABB const& box);
+
+    // 射线最先命中的GeoId，包围盒只用于粗筛，登记了线段的按线段判断，没有时返回GeoId::invalid()
+    BSCI_API virtual GeoId
+    raycast(DimensionType dim, Vec3 const& origin, Vec3 const& dir, float maxDist) const;
+
+    // 与pos距离不超过radius的GeoId中最近的一个，距离的计算方式同raycast，没有时返回GeoId::invalid()
+    BSCI_API virtual GeoId nearest(DimensionType dim, Vec3 const& pos, float radius) const;
+
+    // 用draw画出的图形替换id的内容，id保持不变，后端尽量复用已发送的图形只补发变化部分
+    // draw画出的图形不会单独发送，失败时返回false且id不变
+    BSCI_API virtual bool update(GeoId id, std::function<GeoId(GeometryGroup&)> const& draw);
+
+    enum class Interpolation { Step, Linear, Smooth };
+
+    struct Keyframe {
+        double time;   // 秒，从setMotion时开始计
+        Vec3   offset; // 相对setMotion时的位置
+    };
+
+    struct Motion {
+        Vec3                  velocity{}; // 每秒的位移，没有关键帧时使用
+        std::vector<Keyframe> keyframes;  // 按time升序
+        Interpolation         interpolation{Interpolation::Linear};
+        bool                  loop{};
+
+        bool empty() const { return keyframes.empty() && velocity == Vec3::ZERO(); }
+
+        BSCI_API Vec3 offsetAt(double seconds) const;
+
+        // 之后不会再移动
+        BSCI_API bool finishedAt(double seconds) const;
+    };
+
+    // 让图形持续运动，后端能交给客户端插值的就不再逐tick发送，
+    // 否则服务端每隔motion.shiftInterval个tick shift一次；传入空的motion停在当前位置
+    BSCI_API virtual bool setMotion(GeoId id, Motion const& motion);
+
+    // 隐藏时从客户端移除，但保留存储的数据和索引，显示时直接重发存储的数据，不重新细分
+    // 隐藏期间的shift、update照常生效，merge的结果总是可见；不支持的后端返回false
+    BSCI_API virtual bool setVisible(GeoId id, bool visible);
+
+    // 一次提交一批线段，结果挂在同一个GeoId下，细分出的线段都经由这里交给后端，
+    // 后端据此成批构造图形；默认逐段调用line后merge，跳过长度为0的线段
+    BSCI_API virtual GeoId emitLines(
+        DimensionType            dim,
+        std::span<LineSeg const> segments,
+        mce::Color const&        color     = mce::Color::WHITE(),
+        std::optional<float>     thickness = {}
+    );
+
+    // 数值在[min, max]内均分为colors.size()档，超出范围的归入两端
+    struct Palette {
+        std::vector<mce::Color> colors;
+        float                   min{};
+        float                   max{1};
+    };
+
+    // 以origin为起点、每格一个方块的数据场，values按x、z、y的顺序排列（x变化最快），NaN为空格
+    // 同色相邻格子合并为尽量大的长方体后再绘制
+    BSCI_API virtual GeoId heatmap(
+        DimensionType          dim,
+        BlockPos const&        origin,
+        BlockPos const&        size,
+        std::span<float const> values,
+        Palette const&         palette,
+        std::optional<float>   thickness = {}
+    );
+
+    // 直接给出每格颜色，alpha为0的格子为空
+    BSCI_API virtual GeoId heatmap(
+        DimensionType               dim,
+        BlockPos const&             origin,
+        BlockPos const&             size,
+        std::span<mce::Color const> colors,
+        std::optional<float>        thickness = {}
+    );
+
+    // 三次贝塞尔曲线，按curveTolerance自适应细分，平直处段数少、弯折处段数多
+    BSCI_API virtual GeoId bezier(
+        DimensionType        dim,
+        Vec3 const&          p0,
+        Vec3 const&          p1,
+        Vec3 const&          p2,
+        Vec3 const&          p3,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    );
+
+    // 依次经过所有dots的Catmull-Rom样条，每段转为贝塞尔曲线后同样自适应细分
+    BSCI_API virtual GeoId spline(
+        DimensionType         dim,
+        std::span<Vec3 const> dots,
+        mce::Color const&     color     = mce::Color::WHITE(),
+        std::optional<float>  thickness = {}
+    );
+
+    // 大量采样点，先按cellSize抽稀，再用后端最便宜的图元逐点绘制，返回一个GeoId
+    BSCI_API virtual GeoId points(
+        DimensionType               dim,
+        std::span<Vec3 const>       points,
+        std::span<mce::Color const> colors   = {},
+        std::optional<float>        radius   = {},
+        std::optional<float>        cellSize = {}
+    );
+
+protected:
+    // 用source的内容替换target并使source失效，target的GeoId保持不变
+    // 不支持的后端返回false
+    BSCI_API virtual bool replace(GeoId target, GeoId source);
+
+    // 与replace相同，但source尚未发送过，后端需要自行发送变化的部分
+    BSCI_API virtual bool patch(GeoId target, GeoId source);
 };
 } // namespace bsci
 
@@ -0,0 +1,313 @@
+#ifdef BENCH
+#include "bsci/bench/Bench.h"
+#include "BedrockServerClientInterface.h"
+#include "bsci/GeometryGroup.h"
+#include "bsci/buffered/CommandBufferGroup.h"
+#include "bsci/debug_draw/DebugDrawingHandler.h"
+#include "bsci/network/RecordingPacketSink.h"
+#include "bsci/particle/ParticleSpawner.h"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <ll/api/thread/ServerThreadExecutor.h>
+
+#include <mc/world/level/ChunkPos.h>
+
+namespace bsci::bench {
+
+// 不产生任何包的后端，用于单独测量细分开销
+class NullGeometryGroup : public GeometryGroup {
+public:
+    size_t lines{};
+
+    ~NullGeometryGroup() override { delist(); }
+
+    GeoId line(DimensionType, Vec3 const&, Vec3 const&, mce::Color const&, std::optional<float>)
+        override {
+        ++lines;
+        return getNextGeoId();
+    }
+    bool  remove(GeoId) override { return true; }
+    GeoId merge(std::span<GeoId>) override { return getNextGeoId(); }
+    bool  shift(GeoId, Vec3 const&) override { return true; }
+};
+
+struct Result {
+    std::string name;
+    size_t      ops;
+    double      nsPerOp;
+    double      allocsPerOp;
+    double      packetsPerOp;
+    double      bytesPerOp;
+};
+
+// 只记录不发送，使基准测试不依赖在线客户端
+static std::shared_ptr<RecordingPacketSink> sink;
+static std::vector<Result>                  results;
+static std::vector<std::string>             failures;
+
+// 在服务端线程执行fn并等待其完成
+static void onServerThread(std::function<void()> const& fn) {
+    std::promise<void> done;
+    auto               future = done.get_future();
+    ll::thread::ServerThreadExecutor::getDefault().execute([&] {
+        fn();
+        done.set_value();
+    });
+    future.wait();
+}
+
+// 服务端线程执行器按顺序执行任务，等待哨兵任务即可确认之前的发包已完成
+static void drain() {
+    onServerThread([] {});
+}
+
+template <class F>
+static void measure(std::string name, size_t ops, F&& f) {
+    if (ops == 0) return;
+    sink->reset();
+    auto const allocs = allocationCount();
+    auto const begin  = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        f(i);
+    }
+    auto const end = std::chrono::steady_clock::now();
+    drain();
+    auto const traffic = sink->total();
+    results.push_back({
+        std::move(name),
+        ops,
+        (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()
+            / (double)ops,
+        (double)(allocationCount() - allocs) / (double)ops,
+        (double)traffic.packets / (double)ops,
+        (double)traffic.bytes / (double)ops,
+    });
+}
+
+// 多个生产者线程同时调用，ns/op按总耗时除以总次数计算
+template <class F>
+static void measureParallel(std::string name, size_t threads, size_t ops, F&& f) {
+    sink->reset();
+    auto const allocs = allocationCount();
+    auto const begin  = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                for (size_t i = t; i < ops; i += threads) f(i);
+            });
+        }
+    }
+    auto const end = std::chrono::steady_clock::now();
+    drain();
+    auto const traffic = sink->total();
+    results.push_back({
+        std::move(name),
+        ops,
+        (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()
+            / (double)ops,
+        (double)(allocationCount() - allocs) / (double)ops,
+        (double)traffic.packets / (double)ops,
+        (double)traffic.bytes / (double)ops,
+    });
+}
+
+static Vec3 spread(size_t i) { return {(float)(i % 1024), 80.0f, (float)(i / 1024)}; }
+
+static void benchTessellation() {
+    NullGeometryGroup geo;
+    size_t const      ops = 10000;
+    measure("tessellate/circle r=8", ops, [&](size_t i) {
+        geo.circle(0, spread(i), {0, 1, 0}, 8);
+    });
+    measure("tessellate/sphere r=8", ops, [&](size_t i) { geo.sphere(0, spread(i), 8); });
+    measure("tessellate/cone r=8,4", ops, [&](size_t i) {
+        geo.cone(0, spread(i) + Vec3{0, 8, 0}, spread(i), 4, 8);
+    });
+}
+
+static void check(std::string name, bool ok, RecordingPacketSink::Traffic const& traffic) {
+    auto line = fmt::format(
+        "[{}] {} ({} packets, {} bytes)",
+        ok ? "PASS" : "FAIL",
+        name,
+        traffic.packets,
+        traffic.bytes
+    );
+    BedrockServerClientInterface::getInstance().getLogger().info(line);
+    if (!ok) failures.push_back(std::move(line));
+}
+
+// 检查单次API调用的线上开销
+static void checkWireCost(std::string const& backend, GeometryGroup& geo) {
+    auto const prefix = "wire/" + backend + "/";
+    sink->reset();
+
+    auto box    = geo.box(0, AABB{Vec3{0, 80, 0}, Vec3{4, 84, 4}});
+    auto sphere = geo.sphere(0, Vec3{16, 80, 0}, 4);
+    drain();
+    auto const boxCost    = sink->of(box);
+    auto const sphereCost = sink->of(sphere);
+    check(prefix + "box", boxCost.packets > 0, boxCost);
+    check(prefix + "sphere", sphereCost.packets > 0, sphereCost);
+
+    auto before = sink->total();
+    auto ids    = std::array{box, sphere};
+    auto merged = geo.merge(ids);
+    drain();
+    auto mergeCost = sink->total();
+    mergeCost.packets -= before.packets;
+    mergeCost.bytes   -= before.bytes;
+    check(prefix + "merge sends nothing", mergeCost.packets == 0, mergeCost);
+
+    sink->reset();
+    geo.shift(merged, {0, 1, 0});
+    drain();
+    auto const shiftCost = sink->of(merged);
+    check(
+        prefix + "shift resends each shape once",
+        shiftCost.packets <= boxCost.packets + sphereCost.packets,
+        shiftCost
+    );
+
+    sink->reset();
+    geo.remove(merged);
+    drain();
+    auto const removeCost = sink->of(merged);
+    check(
+        prefix + "remove sends at most one packet per shape",
+        removeCost.packets <= boxCost.packets + sphereCost.packets,
+        removeCost
+    );
+}
+
+static void benchBackend(std::string const& backend, GeometryGroup& geo, size_t count) {
+    auto const prefix = backend + "/" + std::to_string(count) + "/";
+    size_t const groupSize = 16;
+
+    std::vector<GeometryGroup::GeoId> ids(count);
+    measure(prefix + "line", count, [&](size_t i) {
+        ids[i] = geo.line(0, spread(i), spread(i) + Vec3{0, 4, 0});
+    });
+
+    std::vector<GeometryGroup::GeoId> groups(count / groupSize);
+    measure(prefix + "merge x16", groups.size(), [&](size_t i) {
+        groups[i] = geo.merge(std::span{ids}.subspan(i * groupSize, groupSize));
+    });
+
+    measure(prefix + "shift", groups.size(), [&](size_t i) { geo.shift(groups[i], {0, 1, 0}); });
+
+    if (backend == "debugDraw") {
+        NetworkIdentifier netId{};
+        measure(prefix + "chunk replay", 1024, [&](size_t i) {
+            DebugDrawingHandler::replayChunk(
+                ChunkPos{spread(i * 64)},
+                0,
+                netId,
+                SubClientId::PrimaryClient
+            );
+        });
+    }
+
+    measure(prefix + "remove", groups.size(), [&](size_t i) { geo.remove(groups[i]); });
+}
+
+// 只测量生产者一侧，缓冲的命令由服务端tick执行
+static void benchProducers() {
+    size_t const ops = 100000;
+    for (size_t threads : {1, 2, 4, 8}) {
+        auto const suffix = "/" + std::to_string(threads) + " threads";
+        {
+            DebugDrawingHandler geo;
+            measureParallel("producers/direct" + suffix, threads, ops, [&](size_t i) {
+                geo.line(0, spread(i), spread(i) + Vec3{0, 4, 0});
+            });
+        }
+        {
+            CommandBufferGroup geo{std::make_unique<DebugDrawingHandler>()};
+            measureParallel("producers/buffered" + suffix, threads, ops, [&](size_t i) {
+                geo.line(0, spread(i), spread(i) + Vec3{0, 4, 0});
+            });
+        }
+    }
+}
+
+void runBenchmarks() {
+    auto& mod = BedrockServerClientInterface::getInstance();
+    sink      = std::make_shared<RecordingPacketSink>();
+    // 发包和读取配置都在服务端线程，切换也放到服务端线程，避免与正在进行的发送交错
+    bool budget{};
+    onServerThread([&] {
+        PacketSink::set(sink);
+        // 没有玩家在线时预算调度器不会发出任何包
+        auto config           = mod.getConfig();
+        budget                = config.budget.enabled;
+        config.budget.enabled = false;
+        mod.setConfig(std::move(config));
+    });
+
+    benchTessellation();
+    benchProducers();
+    {
+        DebugDrawingHandler geo;
+        checkWireCost("debugDraw", geo);
+    }
+    {
+        ParticleSpawner geo;
+        checkWireCost("particle", geo);
+    }
+    for (size_t count : {1000, 10000, 100000, 1000000}) {
+        {
+            DebugDrawingHandler geo;
+            benchBackend("debugDraw", geo, count);
+        }
+        {
+            ParticleSpawner geo;
+            benchBackend("particle", geo, count);
+        }
+    }
+
+    onServerThread([&] {
+        PacketSink::set(nullptr);
+        auto config           = mod.getConfig();
+        config.budget.enabled = budget;
+        mod.setConfig(std::move(config));
+    });
+
+    std::ofstream out{mod.getSelf().getDataDir() / u8"bench_output.txt"};
+    for (auto& r : results) {
+        auto line = fmt::format(
+            "{:<36} {:>8} ops {:>12.1f} ns/op {:>8.2f} allocs/op {:>8.2f} packets/op {:>10.1f} "
+            "bytes/op",
+            r.name,
+            r.ops,
+            r.nsPerOp,
+            r.allocsPerOp,
+            r.packetsPerOp,
+            r.bytesPerOp
+        );
+        mod.getLogger().info(line);
+        out << line << '\n';
+    }
+    for (auto& f : failures) {
+        mod.getLogger().error(f);
+        out << f << '\n';
+    }
+    results.clear();
+    failures.clear();
+    sink.reset();
+}
+} // namespace bsci::bench
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#ifdef BENCH
+#include <cstddef>
+
+namespace bsci::bench {
+void countAllocation();
+
+size_t allocationCount();
+
+// 在后台线程中运行，需要服务端线程正常tick以执行发包任务
+void runBenchmarks();
+} // namespace bsci::bench
+
+#endif
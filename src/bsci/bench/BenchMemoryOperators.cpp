@@ -0,0 +1,59 @@
+#ifdef BENCH
+#include "bsci/bench/Bench.h"
+
+#include <atomic>
+#include <new>
+
+#include "ll/api/memory/Memory.h"
+
+// 替代memory/MempryOperators.cpp，在转发到默认分配器的同时统计分配次数
+
+namespace bsci::bench {
+static std::atomic_size_t allocations{};
+
+void countAllocation() { allocations.fetch_add(1, std::memory_order_relaxed); }
+
+size_t allocationCount() { return allocations.load(std::memory_order_relaxed); }
+} // namespace bsci::bench
+
+static void* allocate(size_t size) {
+    bsci::bench::countAllocation();
+    return ll::memory::getDefaultAllocator().allocate(size);
+}
+static void* alignedAllocate(size_t size, std::align_val_t align) {
+    bsci::bench::countAllocation();
+    return ll::memory::getDefaultAllocator().alignedAllocate(size, (size_t)align);
+}
+static void release(void* block) { ll::memory::getDefaultAllocator().release(block); }
+static void alignedRelease(void* block) { ll::memory::getDefaultAllocator().alignedRelease(block); }
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::nothrow_t const&) noexcept { return allocate(size); }
+void* operator new[](size_t size, std::nothrow_t const&) noexcept { return allocate(size); }
+void* operator new(size_t size, std::align_val_t align) { return alignedAllocate(size, align); }
+void* operator new[](size_t size, std::align_val_t align) { return alignedAllocate(size, align); }
+void* operator new(size_t size, std::align_val_t align, std::nothrow_t const&) noexcept {
+    return alignedAllocate(size, align);
+}
+void* operator new[](size_t size, std::align_val_t align, std::nothrow_t const&) noexcept {
+    return alignedAllocate(size, align);
+}
+
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, size_t) noexcept { release(block); }
+void operator delete[](void* block, size_t) noexcept { release(block); }
+void operator delete(void* block, std::nothrow_t const&) noexcept { release(block); }
+void operator delete[](void* block, std::nothrow_t const&) noexcept { release(block); }
+void operator delete(void* block, std::align_val_t) noexcept { alignedRelease(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { alignedRelease(block); }
+void operator delete(void* block, size_t, std::align_val_t) noexcept { alignedRelease(block); }
+void operator delete[](void* block, size_t, std::align_val_t) noexcept { alignedRelease(block); }
+void operator delete(void* block, std::align_val_t, std::nothrow_t const&) noexcept {
+    alignedRelease(block);
+}
+void operator delete[](void* block, std::align_val_t, std::nothrow_t const&) noexcept {
+    alignedRelease(block);
+}
+#endif
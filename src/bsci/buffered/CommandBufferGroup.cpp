@@ -0,0 +1,437 @@
+#include "bsci/buffered/CommandBufferGroup.h"
+
+#include "bsci/utils/ShapeRecord.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include <ll/api/event/EventBus.h>
+#include <ll/api/event/Listener.h>
+#include <ll/api/event/world/ServerLevelTickEvent.h>
+
+namespace bsci {
+
+// 每个线程固定写入其中一个分片，分片数足够时生产者之间几乎不会竞争
+constexpr size_t shardCount = 64;
+
+static size_t threadSlot() {
+    static std::atomic_size_t next{};
+    thread_local size_t const slot = next.fetch_add(1, std::memory_order_relaxed) % shardCount;
+    return slot;
+}
+
+class CommandBufferGroup::Impl {
+public:
+    struct Remove {};
+    struct Clear {};
+    struct RemoveIn {
+        DimensionType dim;
+        AABB          box;
+    };
+    struct Merge {
+        std::vector<GeoId> ids;
+    };
+    struct Shift {
+        Vec3 offset;
+    };
+    struct Update {
+        std::function<GeoId(GeometryGroup&)> draw;
+    };
+    struct SetMotion {
+        Motion motion;
+    };
+    struct SetVisible {
+        bool visible;
+    };
+    using Command = std::variant<
+        shape::Record,
+        Remove,
+        Clear,
+        RemoveIn,
+        Merge,
+        Shift,
+        Update,
+        SetMotion,
+        SetVisible>;
+
+    struct Node {
+        uint64  seq;
+        GeoId   id; // 绘制与合并命令预留的GeoId，或移除与移动的目标
+        Command command;
+        bool    retried{};
+        Node*   next{};
+    };
+
+    struct alignas(64) Shard {
+        std::atomic<Node*> head{};
+    };
+
+    std::unique_ptr<GeometryGroup> inner;
+    std::array<Shard, shardCount>  shards;
+    std::atomic<uint64>            seq{};
+    ll::event::ListenerPtr         listener;
+
+    // 以下只在服务端线程访问
+    std::unordered_map<uint64, GeoId> ids;      // 预留的GeoId到内部GeoId
+    std::unordered_map<uint64, GeoId> reserved; // 内部GeoId到预留的GeoId
+    std::vector<Node*>                carried;
+
+    explicit Impl(std::unique_ptr<GeometryGroup> inner) : inner(std::move(inner)) {}
+
+    ~Impl() {
+        for (auto& shard : shards) {
+            for (auto node = shard.head.load(); node;) delete std::exchange(node, node->next);
+        }
+        for (auto node : carried) delete node;
+    }
+
+    // 调用者拿到GeoId前命令已入队，所以依赖它的命令seq一定更大
+    GeoId push(GeoId id, Command&& command) {
+        auto  node = new Node{seq.fetch_add(1, std::memory_order_relaxed), id, std::move(command)};
+        auto& head = shards[threadSlot()].head;
+        node->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(
+            node->next,
+            node,
+            std::memory_order_release,
+            std::memory_order_relaxed
+        )) {}
+        return id;
+    }
+
+    void apply() {
+        std::vector<Node*> nodes;
+        nodes.swap(carried);
+        for (auto& shard : shards) {
+            for (auto node = shard.head.exchange(nullptr, std::memory_order_acquire); node;
+                 node      = node->next) {
+                nodes.push_back(node);
+            }
+        }
+        std::sort(nodes.begin(), nodes.end(), [](auto a, auto b) { return a->seq < b->seq; });
+        for (auto node : nodes) {
+            if (std::visit([&](auto& command) { return run(*node, command); }, node->command)) {
+                delete node;
+            } else {
+                // 依赖的命令可能刚好在取队列之后才入队，留到下一批再试一次
+                node->retried = true;
+                carried.push_back(node);
+            }
+        }
+    }
+
+    void bind(GeoId id, GeoId innerId) {
+        if (innerId.value == 0) return;
+        ids.emplace(id.value, innerId);
+        reserved.emplace(innerId.value, id);
+    }
+
+    // 内部GeoId对应的预留GeoId，不是经由本组创建的返回GeoId::invalid()
+    GeoId outer(GeoId innerId) const {
+        auto it = reserved.find(innerId.value);
+        return it == reserved.end() ? GeoId::invalid() : it->second;
+    }
+
+    void unbind(GeoId innerId) {
+        auto it = reserved.find(innerId.value);
+        if (it == reserved.end()) return;
+        ids.erase(it->second.value);
+        reserved.erase(it);
+    }
+
+    bool run(Node& node, shape::Record& c) {
+        bind(node.id, shape::draw(*inner, c));
+        return true;
+    }
+    bool run(Node& node, Remove&) {
+        auto it = ids.find(node.id.value);
+        if (it == ids.end()) return node.retried;
+        inner->remove(it->second);
+        unbind(it->second);
+        return true;
+    }
+    bool run(Node&, Clear&) {
+        inner->clear();
+        ids.clear();
+        reserved.clear();
+        return true;
+    }
+    bool run(Node&, RemoveIn& c) {
+        for (auto& innerId : inner->queryIn(c.dim, c.box)) {
+            inner->remove(innerId);
+            unbind(innerId);
+        }
+        return true;
+    }
+    bool run(Node& node, Shift& c) {
+        auto it = ids.find(node.id.value);
+        if (it == ids.end()) return node.retried;
+        inner->shift(it->second, c.offset);
+        return true;
+    }
+    bool run(Node& node, Update& c) {
+        auto it = ids.find(node.id.value);
+        if (it == ids.end()) return node.retried;
+        inner->update(it->second, c.draw);
+        return true;
+    }
+    bool run(Node& node, SetMotion& c) {
+        auto it = ids.find(node.id.value);
+        if (it == ids.end()) return node.retried;
+        inner->setMotion(it->second, c.motion);
+        return true;
+    }
+    bool run(Node& node, SetVisible& c) {
+        auto it = ids.find(node.id.value);
+        if (it == ids.end()) return node.retried;
+        inner->setVisible(it->second, c.visible);
+        return true;
+    }
+    bool run(Node& node, Merge& c) {
+        std::vector<GeoId> innerIds;
+        innerIds.reserve(c.ids.size());
+        for (auto& id : c.ids) {
+            auto it = ids.find(id.value);
+            if (it == ids.end()) {
+                if (!node.retried) return false;
+                continue;
+            }
+            innerIds.push_back(it->second);
+        }
+        for (auto& id : innerIds) unbind(id);
+        bind(node.id, inner->merge(innerIds));
+        return true;
+    }
+};
+
+CommandBufferGroup::CommandBufferGroup(std::unique_ptr<GeometryGroup> inner)
+: impl(std::make_shared<Impl>(std::move(inner))) {
+    impl->listener =
+        ll::event::EventBus::getInstance().emplaceListener<ll::event::world::ServerLevelTickEvent>(
+            [weak = std::weak_ptr{impl}](ll::event::world::ServerLevelTickEvent&) {
+                if (auto self = weak.lock()) self->apply();
+            }
+        );
+}
+
+CommandBufferGroup::~CommandBufferGroup() {
+    delist();
+    // 内部的GeometryGroup随impl一起析构，由它负责清理
+    if (clearsOnDestroy()) impl->inner->setClearOnDestroy(true);
+    ll::event::EventBus::getInstance().removeListener<ll::event::world::ServerLevelTickEvent>(
+        impl->listener
+    );
+}
+
+void CommandBufferGroup::flush() { impl->apply(); }
+
+GeometryGroup::Stats CommandBufferGroup::stats() const {
+    Stats res{"commandBuffer"};
+    res.geoIds = impl->ids.size();
+    return res;
+}
+
+GeometryGroup::GeoId CommandBufferGroup::point(
+    DimensionType        dim,
+    Vec3 const&          pos,
+    mce::Color const&    color,
+    std::optional<float> radius
+) {
+    return impl->push(getNextGeoId(), shape::Point{dim, pos, color, radius});
+}
+
+GeometryGroup::GeoId CommandBufferGroup::line(
+    DimensionType        dim,
+    Vec3 const&          begin,
+    Vec3 const&          end,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    if (begin == end) return GeoId::invalid();
+    return impl->push(getNextGeoId(), shape::Line{dim, begin, end, color, thickness});
+}
+
+GeometryGroup::GeoId CommandBufferGroup::line(
+    DimensionType        dim,
+    std::span<Vec3>      dots,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    if (dots.size() < 2) return GeoId::invalid();
+    return impl->push(
+        getNextGeoId(),
+        shape::Polyline{dim, {dots.begin(), dots.end()}, color, thickness}
+    );
+}
+
+GeometryGroup::GeoId CommandBufferGroup::emitLines(
+    DimensionType            dim,
+    std::span<LineSeg const> segments,
+    mce::Color const&        color,
+    std::optional<float>     thickness
+) {
+    if (segments.empty()) return GeoId::invalid();
+    return impl->push(
+        getNextGeoId(),
+        shape::Lines{dim, {segments.begin(), segments.end()}, color, thickness}
+    );
+}
+
+GeometryGroup::GeoId CommandBufferGroup::box(
+    DimensionType        dim,
+    AABB const&          box,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->push(getNextGeoId(), shape::Box{dim, box, color, thickness});
+}
+
+GeometryGroup::GeoId CommandBufferGroup::circle(
+    DimensionType        dim,
+    Vec3 const&          center,
+    Vec3 const&          normal,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->push(getNextGeoId(), shape::Circle{dim, center, normal, radius, color, thickness});
+}
+
+GeometryGroup::GeoId CommandBufferGroup::cylinder(
+    DimensionType        dim,
+    Vec3 const&          topCenter,
+    Vec3 const&          bottomCenter,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->push(
+        getNextGeoId(),
+        shape::Cylinder{dim, topCenter, bottomCenter, radius, color, thickness}
+    );
+}
+
+GeometryGroup::GeoId CommandBufferGroup::sphere(
+    DimensionType        dim,
+    Vec3 const&          center,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->push(getNextGeoId(), shape::Sphere{dim, center, radius, color, thickness});
+}
+
+GeometryGroup::GeoId CommandBufferGroup::arrow(
+    DimensionType        dim,
+    Vec3 const&          begin,
+    Vec3 const&          end,
+    mce::Color const&    color,
+    std::optional<float> mArrowHeadLength,
+    std::optional<float> mArrowHeadRadius
+) {
+    if (begin == end) return GeoId::invalid();
+    return impl->push(
+        getNextGeoId(),
+        shape::Arrow{dim, begin, end, color, mArrowHeadLength, mArrowHeadRadius}
+    );
+}
+
+GeometryGroup::GeoId CommandBufferGroup::text(
+    DimensionType        dim,
+    Vec3 const&          pos,
+    std::string          text,
+    mce::Color const&    color,
+    std::optional<float> scale
+) {
+    return impl->push(getNextGeoId(), shape::Text{dim, pos, std::move(text), color, scale});
+}
+
+GeometryGroup::GeoId CommandBufferGroup::cone(
+    DimensionType        dim,
+    Vec3 const&          topCenter,
+    Vec3 const&          bottomCenter,
+    float                topRadius,
+    float                bottomRadius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->push(
+        getNextGeoId(),
+        shape::Cone{dim, topCenter, bottomCenter, topRadius, bottomRadius, color, thickness}
+    );
+}
+
+bool CommandBufferGroup::remove(GeoId id) {
+    if (id.value == 0) return false;
+    impl->push(id, Impl::Remove{});
+    return true;
+}
+
+std::vector<GeometryGroup::GeoId>
+CommandBufferGroup::queryIn(DimensionType dim, AABB const& box) const {
+    std::vector<GeoId> res;
+    for (auto& innerId : impl->inner->queryIn(dim, box)) {
+        if (auto id = impl->outer(innerId); id.value != 0) res.push_back(id);
+    }
+    return res;
+}
+
+GeometryGroup::GeoId CommandBufferGroup::raycast(
+    DimensionType dim,
+    Vec3 const&   origin,
+    Vec3 const&   dir,
+    float         maxDist
+) const {
+    return impl->outer(impl->inner->raycast(dim, origin, dir, maxDist));
+}
+
+GeometryGroup::GeoId
+CommandBufferGroup::nearest(DimensionType dim, Vec3 const& pos, float radius) const {
+    return impl->outer(impl->inner->nearest(dim, pos, radius));
+}
+
+size_t CommandBufferGroup::removeIn(DimensionType dim, AABB const& box) {
+    impl->push(GeoId::invalid(), Impl::RemoveIn{dim, box});
+    return 0;
+}
+
+size_t CommandBufferGroup::clear() {
+    impl->push(GeoId::invalid(), Impl::Clear{});
+    return 0;
+}
+
+GeometryGroup::GeoId CommandBufferGroup::merge(std::span<GeoId> ids) {
+    if (ids.empty()) return GeoId::invalid();
+    return impl->push(getNextGeoId(), Impl::Merge{{ids.begin(), ids.end()}});
+}
+
+bool CommandBufferGroup::shift(GeoId id, Vec3 const& v) {
+    if (id.value == 0) return false;
+    impl->push(id, Impl::Shift{v});
+    return true;
+}
+
+bool CommandBufferGroup::update(GeoId id, std::function<GeoId(GeometryGroup&)> const& draw) {
+    if (id.value == 0) return false;
+    impl->push(id, Impl::Update{draw});
+    return true;
+}
+
+bool CommandBufferGroup::setMotion(GeoId id, Motion const& motion) {
+    if (id.value == 0) return false;
+    impl->push(id, Impl::SetMotion{motion});
+    return true;
+}
+
+bool CommandBufferGroup::setVisible(GeoId id, bool visible) {
+    if (id.value == 0) return false;
+    impl->push(id, Impl::SetVisible{visible});
+    return true;
+}
+} // namespace bsci
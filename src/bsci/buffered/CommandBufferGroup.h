@@ -0,0 +1,146 @@
+#pragma once
+
+#include "bsci/GeometryGroup.h"
+
+#include <memory>
+
+namespace bsci {
+// 可在任意线程调用的前端：调用只把命令压入无锁队列并立即返回预留的GeoId，
+// 服务端线程每tick按调用顺序把命令批量交给内部的GeometryGroup执行
+class CommandBufferGroup : public GeometryGroup {
+    class Impl;
+    std::shared_ptr<Impl> impl;
+
+public:
+    BSCI_API explicit CommandBufferGroup(std::unique_ptr<GeometryGroup> inner);
+
+    BSCI_API ~CommandBufferGroup() override;
+
+    // 只能在服务端线程调用，立即执行所有已排队的命令
+    BSCI_API void flush();
+
+    Stats stats() const override;
+
+    GeoId point(
+        DimensionType        dim,
+        Vec3 const&          pos,
+        mce::Color const&    color  = mce::Color::WHITE(),
+        std::optional<float> radius = {}
+    ) override;
+
+    GeoId line(
+        DimensionType        dim,
+        Vec3 const&          begin,
+        Vec3 const&          end,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId line(
+        DimensionType        dim,
+        std::span<Vec3>      dots,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    // 整批线段作为一条命令排队
+    GeoId emitLines(
+        DimensionType            dim,
+        std::span<LineSeg const> segments,
+        mce::Color const&        color     = mce::Color::WHITE(),
+        std::optional<float>     thickness = {}
+    ) override;
+
+    GeoId
+    box(DimensionType        dim,
+        AABB const&          box,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}) override;
+
+    GeoId circle(
+        DimensionType        dim,
+        Vec3 const&          center,
+        Vec3 const&          normal,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId cylinder(
+        DimensionType        dim,
+        Vec3 const&          topCenter,
+        Vec3 const&          bottomCenter,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId sphere(
+        DimensionType        dim,
+        Vec3 const&          center,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId arrow(
+        DimensionType        dim,
+        Vec3 const&          begin,
+        Vec3 const&          end,
+        mce::Color const&    color            = mce::Color::WHITE(),
+        std::optional<float> mArrowHeadLength = {},
+        std::optional<float> mArrowHeadRadius = {}
+    ) override;
+
+    GeoId text(
+        DimensionType        dim,
+        Vec3 const&          pos,
+        std::string          text,
+        mce::Color const&    color = mce::Color::WHITE(),
+        std::optional<float> scale = {}
+    ) override;
+
+    GeoId cone(
+        DimensionType        dim,
+        Vec3 const&          topCenter,
+        Vec3 const&          bottomCenter,
+        float                topRadius,
+        float                bottomRadius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    // 返回值只表示命令已排队
+    bool remove(GeoId) override;
+
+    // 排队在此之前的命令执行完后清空，返回0
+    size_t clear() override;
+
+    // 只能在服务端线程调用，结果不包含尚未执行的命令
+    std::vector<GeoId> queryIn(DimensionType dim, AABB const& box) const override;
+
+    // 返回0，移除在下一批命令执行时进行
+    size_t removeIn(DimensionType dim, AABB const& box) override;
+
+    // 只能在服务端线程调用
+    GeoId raycast(DimensionType dim, Vec3 const& origin, Vec3 const& dir, float maxDist)
+        const override;
+
+    // 只能在服务端线程调用
+    GeoId nearest(DimensionType dim, Vec3 const& pos, float radius) const override;
+
+    GeoId merge(std::span<GeoId>) override;
+
+    // 返回值只表示命令已排队
+    bool shift(GeoId, Vec3 const&) override;
+
+    // draw在服务端线程上以内部的GeometryGroup为参数调用，返回值只表示命令已排队
+    bool update(GeoId id, std::function<GeoId(GeometryGroup&)> const& draw) override;
+
+    // 返回值只表示命令已排队
+    bool setMotion(GeoId id, Motion const& motion) override;
+
+    // 返回值只表示命令已排队
+    bool setVisible(GeoId id, bool visible) override;
+};
+} // namespace bsci
@@ -0,0 +1,83 @@
+#include "bsci/command/Command.h"
+#include "BedrockServerClientInterface.h"
+#include "bsci/GeometryGroup.h"
+#include "bsci/network/SendScheduler.h"
+#include "bsci/utils/Metrics.h"
+
+#include <fmt/format.h>
+
+#include "ll/api/command/CommandHandle.h"
+#include "ll/api/command/CommandRegistrar.h"
+#include "ll/api/command/runtime/RuntimeCommand.h"
+#include "ll/api/command/runtime/RuntimeOverload.h"
+#include "mc/server/commands/CommandOutput.h"
+#include "mc/server/commands/CommandPermissionLevel.h"
+
+namespace bsci::command {
+void registerCommand() {
+    static bool registered{};
+    if (registered) return;
+    registered = true;
+
+    auto& cmd = ll::command::CommandRegistrar::getInstance(false).getOrCreateCommand(
+        "bsci",
+        "BedrockServerClientInterface",
+        CommandPermissionLevel::GameDirectors
+    );
+
+    cmd.runtimeOverload().text("stats").execute(
+        [](CommandOrigin const&, CommandOutput& output, ll::command::RuntimeCommand const&) {
+            size_t index{};
+            GeometryGroup::forEach([&](GeometryGroup& group) {
+                auto s = group.stats();
+                output.success(fmt::format(
+                    "#{} {}: {} GeoIds, {} primitives, {} chunk index entries",
+                    index++,
+                    s.backend,
+                    s.geoIds,
+                    s.primitives,
+                    s.chunkIndexSize
+                ));
+            });
+            auto rates = metrics::rates();
+            output.success(fmt::format(
+                "sent {:.1f} packets/tick, {:.0f} bytes/tick, resend tick {:.1f}us",
+                rates.packetsPerTick,
+                rates.bytesPerTick,
+                rates.resendTickMicros
+            ));
+            output.success(fmt::format(
+                "FullChunkData hook {:.1f}us/tick, {} calls, {:.1f}ms total",
+                rates.chunkHookMicrosPerTick,
+                metrics::total(metrics::Counter::ChunkHookCalls),
+                (double)metrics::total(metrics::Counter::ChunkHookNanos) / 1e6
+            ));
+            output.success(fmt::format(
+                "executor tasks queued {}, budgeted sends queued {}",
+                metrics::total(metrics::Counter::TasksQueued)
+                    - metrics::total(metrics::Counter::TasksDone),
+                SendScheduler::getInstance().queued()
+            ));
+        }
+    );
+
+    cmd.runtimeOverload().text("reload").execute(
+        [](CommandOrigin const&, CommandOutput& output, ll::command::RuntimeCommand const&) {
+            if (!BedrockServerClientInterface::getInstance().reloadConfig()) {
+                output.error("failed to reload config, keeping the current one");
+                return;
+            }
+            size_t groups{}, shapes{};
+            GeometryGroup::forEach([&](GeometryGroup& group) {
+                ++groups;
+                shapes += group.reload();
+            });
+            output.success(fmt::format(
+                "config reloaded, re-tessellated {} shapes in {} groups",
+                shapes,
+                groups
+            ));
+        }
+    );
+}
+} // namespace bsci::command
@@ -0,0 +1,5 @@
+#pragma once
+
+namespace bsci::command {
+void registerCommand();
+}
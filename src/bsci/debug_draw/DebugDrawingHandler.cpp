@@ -1,16 +1,30 @@
 #include "DebugDrawingHandler.h"
 #include "BedrockServerClientInterface.h"
+#include "bsci/network/PacketSink.h"
+#include "bsci/network/SendScheduler.h"
+#include "bsci/network/ViewerSet.h"
+#include "bsci/utils/Metrics.h"
+#include "bsci/utils/Snapshot.h"
+#include "bsci/utils/SlotPool.h"
+#include "bsci/utils/SpatialIndex.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
-#include <iterator>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <variant>
 #include <vector>
 
 #include <ll/api/base/Containers.h>
+#include <ll/api/event/EventBus.h>
+#include <ll/api/event/world/ServerLevelTickEvent.h>
 #include <ll/api/memory/Hook.h>
 #include <ll/api/thread/ServerThreadExecutor.h>
 
@@ -21,6 +35,7 @@
 #include <mc/network/packet/DebugDrawerPacketPayload.h>
 #include <mc/network/packet/LevelChunkPacket.h>
 #include <mc/network/packet/ShapeDataPayload.h>
+#include <mc/world/actor/player/Player.h>
 #include <mc/world/level/ChunkPos.h>
 
 
@@ -36,56 +51,680 @@ static std::atomic<uint64_t> nextId_{UINT64_MAX};
 
 constexpr size_t shapeDisplayRadius = 48;
 
-class DebugDrawingHandler::Impl {
+// 单个包内最多的图形数，避免合并后的包过大
+constexpr size_t maxShapesPerPacket = 256;
+
+class DebugDrawingHandler::Impl : public std::enable_shared_from_this<Impl> {
 public:
-    using PacketPair = std::pair<GeoId, std::vector<std::weak_ptr<DebugDrawerPacket>>>;
+    struct Shape {
+        GeoId            owner; // merge后会更新为新的GeoId
+        ShapeDataPayload payload;
+    };
+    using Pool       = SlotPool<Shape>;
+    using Handle     = Pool::Handle;
+    using Handles    = HandleList<Handle>;
+    using ChunkKey   = std::pair<ChunkPos, int>;
+    using HandlePair = std::pair<GeoId, Handles>;
+    using ChunkIndex = ll::ConcurrentDenseMap<ChunkPos, std::vector<HandlePair>>; // 按GeoId排序
+
+    // 同一GeoId在同一区块中的图形，发送时合为一个包
+    struct Batch {
+        GeoId               id;
+        Vec3                pos; // 第一个图形的位置，用于计算发送优先级
+        int                 dim;
+        std::vector<Handle> handles;
+    };
+
     struct Hook;
     size_t id{};
-    ll::ConcurrentDenseMap<GeoId, std::vector<std::shared_ptr<DebugDrawerPacket>>>
-        geoPackets; // bool = true 表示启用ParticleSpawner
-    ll::ConcurrentDenseMap<std::pair<ChunkPos, int>, std::vector<PacketPair>>
-        chunkPackets; // 不应包含使用ParticleSpawner的GeoId
+
+    std::shared_ptr<ViewerSet> viewers; // 为空时发给所有玩家
+    size_t                     viewerToken{};
+
+    // add全程持有共享锁，clear持有独占锁，图形不会一半登记在清空前、一半在清空后
+    std::shared_mutex clearMutex;
+
+    mutable std::shared_mutex              poolMutex;
+    Pool                                   shapes; // 图形数据只在这里保存一份
+    ll::ConcurrentDenseMap<GeoId, Handles> geoShapes;
+
+    // 每个维度一份区块索引，互不争用锁；只增不删，取出的指针一直有效
+    mutable std::shared_mutex                  indexMutex;
+    std::map<int, std::unique_ptr<ChunkIndex>> chunkShapes;
+
+    std::mutex          pendingMutex;
+    std::vector<Handle> pending; // 等待下一次flush发送的新图形
+    bool                flushQueued{};
+
+    mutable std::shared_mutex  hiddenMutex;
+    std::unordered_set<uint64> hidden; // 隐藏的GeoId，图形仍在池和区块索引中
 
 public:
-    // void sendPacketImmediately(DebugDrawerPacket& pkt) {
-    //     if (pkt.mShapes->empty()) return;
-    //     ll::thread::ServerThreadExecutor::getDefault().execute([pkt] { pkt.sendToClients(); });
-    // }
+    static std::optional<ChunkKey> keyOf(ShapeDataPayload const& shape) {
+        if (!shape.mLocation->has_value() || !shape.mDimensionId->has_value()) return std::nullopt;
+        return ChunkKey{ChunkPos(shape.mLocation->value()), (int)shape.mDimensionId->value()};
+    }
+
+    ChunkIndex* chunksIn(int dim) const {
+        std::shared_lock l{indexMutex};
+        auto             it = chunkShapes.find(dim);
+        return it == chunkShapes.end() ? nullptr : it->second.get();
+    }
 
-    static bool compareByGeoId(const PacketPair& a, const GeoId& b) {
+    ChunkIndex& chunksOf(int dim) {
+        if (auto chunks = chunksIn(dim)) return *chunks;
+        std::unique_lock l{indexMutex};
+        auto&            chunks = chunkShapes[dim];
+        if (!chunks) chunks = std::make_unique<ChunkIndex>();
+        return *chunks;
+    }
+
+    size_t indexSize() const {
+        std::shared_lock l{indexMutex};
+        size_t           res{};
+        for (auto& [dim, chunks] : chunkShapes) res += chunks->size();
+        return res;
+    }
+
+    // 用于空间索引，文字只算作一个点
+    static AABB boundsOf(ShapeDataPayload const& shape) {
+        auto const  pos    = shape.mLocation->value_or(Vec3::ZERO());
+        AABB        res{pos, pos};
+        auto const  extend = [&res](Vec3 const& p) { res = SpatialIndex::unite(res, {p, p}); };
+        auto const  type   = *shape.mShapeType;
+        auto const& extra  = *shape.mExtraDataPayload;
+        if (auto line = std::get_if<LineDataPayload>(&extra)) {
+            extend(*line->mEndLocation);
+        } else if (auto arrow = std::get_if<ArrowDataPayload>(&extra)) {
+            if (arrow->mEndLocation->has_value()) extend(arrow->mEndLocation->value());
+        } else if (auto box = std::get_if<BoxDataPayload>(&extra)) {
+            auto const half = *box->mBoxBound * 0.5f;
+            res             = {pos - half, pos + half};
+        } else if (type == ScriptModuleDebugUtilities::ScriptDebugShapeType::Circle
+                   || type == ScriptModuleDebugUtilities::ScriptDebugShapeType::Sphere) {
+            auto const r = shape.mScale->value_or(1.0f);
+            res          = {pos - Vec3{r, r, r}, pos + Vec3{r, r, r}};
+        }
+        return res;
+    }
+
+    static bool compareByGeoId(HandlePair const& a, GeoId const& b) {
         return a.first.value < b.value;
     }
 
-    void
-    addPacket(GeoId geoId, std::shared_ptr<DebugDrawerPacket>& packet, int dimId, Vec3 const& pos) {
-        if (packet) {
-            geoPackets.emplace(geoId, std::vector<std::shared_ptr<DebugDrawerPacket>>{packet});
-            auto chunkPos         = ChunkPos(pos);
-            auto key              = std::make_pair(chunkPos, dimId);
-            auto [iter, inserted] = chunkPackets.try_emplace(key);
-
-            if (inserted) {
-                iter->second.emplace_back(
-                    geoId,
-                    std::vector<std::weak_ptr<DebugDrawerPacket>>{packet}
-                );
-            } else {
-                auto it = std::lower_bound(
-                    iter->second.begin(),
-                    iter->second.end(),
-                    geoId,
-                    compareByGeoId
-                );
-                iter->second
-                    .emplace(it, geoId, std::vector<std::weak_ptr<DebugDrawerPacket>>{packet});
+    void index(ChunkKey const& key, GeoId geoId, Handles&& handles) {
+        chunksOf(key.second).lazy_emplace_l(
+            key.first,
+            [&](auto&& iter) {
+                auto it =
+                    std::lower_bound(iter.second.begin(), iter.second.end(), geoId, compareByGeoId);
+                if (it != iter.second.end() && it->first == geoId) {
+                    it->second.append(std::move(handles));
+                } else {
+                    iter.second.emplace(it, geoId, std::move(handles));
+                }
+            },
+            [&](auto const& ctor) {
+                std::vector<HandlePair> pairs;
+                pairs.emplace_back(geoId, std::move(handles));
+                ctor(key.first, std::move(pairs));
+            }
+        );
+    }
+
+    void unindex(ChunkKey const& key, GeoId geoId) {
+        auto chunks = chunksIn(key.second);
+        if (!chunks) return;
+        chunks->erase_if(key.first, [geoId](auto&& iter) {
+            auto it =
+                std::lower_bound(iter.second.begin(), iter.second.end(), geoId, compareByGeoId);
+            if (it != iter.second.end() && it->first == geoId) iter.second.erase(it);
+            return iter.second.empty();
+        });
+    }
+
+    GeoId add(GeoId geoId, ShapeDataPayload&& shape) {
+        std::shared_lock c{clearMutex};
+        auto             key = keyOf(shape);
+        Handle           handle;
+        {
+            std::unique_lock l{poolMutex};
+            handle = shapes.emplace(geoId, std::move(shape));
+        }
+        geoShapes.try_emplace_l(
+            geoId,
+            [handle](auto&& iter) { iter.second.push_back(handle); },
+            Handles{handle}
+        );
+        if (key) index(*key, geoId, Handles{handle});
+        if (!isStaging()) queueSend({&handle, 1});
+        return geoId;
+    }
+
+    // 成批登记同一GeoId下的图形：池只加一次锁，相邻的同区块图形合并索引，只排队发送一次
+    GeoId add(GeoId geoId, std::vector<ShapeDataPayload>&& batch) {
+        std::shared_lock                     c{clearMutex};
+        std::vector<std::optional<ChunkKey>> keys;
+        keys.reserve(batch.size());
+        for (auto& shape : batch) keys.push_back(keyOf(shape));
+
+        std::vector<Handle> handles;
+        handles.reserve(batch.size());
+        {
+            std::unique_lock l{poolMutex};
+            for (auto& shape : batch) handles.push_back(shapes.emplace(geoId, std::move(shape)));
+        }
+        Handles all;
+        for (auto handle : handles) all.push_back(handle);
+        geoShapes.try_emplace_l(
+            geoId,
+            [&all](auto&& iter) { iter.second.append(std::move(all)); },
+            std::move(all)
+        );
+
+        // 细分出的线段首尾相接，相邻的通常落在同一区块
+        for (size_t first = 0; first < handles.size();) {
+            size_t last = first + 1;
+            while (last < handles.size() && keys[last] == keys[first]) last++;
+            if (keys[first]) {
+                Handles run;
+                for (size_t i = first; i < last; i++) run.push_back(handles[i]);
+                index(*keys[first], geoId, std::move(run));
+            }
+            first = last;
+        }
+        if (!isStaging()) queueSend(handles);
+        return geoId;
+    }
+
+    // 恢复快照中的图形，之后分配的networkId不能与其重复
+    void restore(GeoId geoId, ShapeDataPayload&& shape) {
+        uint64_t const networkId = *shape.mNetworkId;
+        auto           current   = nextId_.load();
+        while (current >= networkId && !nextId_.compare_exchange_weak(current, networkId - 1)) {}
+        add(geoId, std::move(shape));
+    }
+
+    // 所有新图形攒到同一个任务里发送，而不是每个图形提交一次
+    void queueSend(std::span<Handle const> handles) {
+        {
+            std::lock_guard l{pendingMutex};
+            pending.insert(pending.end(), handles.begin(), handles.end());
+            if (flushQueued) return;
+            flushQueued = true;
+        }
+        metrics::execute([weak = weak_from_this()] {
+            if (auto self = weak.lock()) self->flush();
+        });
+    }
+
+    void flush() {
+        std::vector<Handle> handles;
+        {
+            std::lock_guard l{pendingMutex};
+            handles.swap(pending);
+            flushQueued = false;
+        }
+        for (auto& batch : batchesOf(handles)) sendNearby(std::move(batch));
+    }
+
+    // 移动后的图形直接发送，不进入SendScheduler排在新图形之后，与移除一致
+    void sendShifted(std::span<Handle const> handles) {
+        std::vector<Handle> copy{handles.begin(), handles.end()};
+        metrics::execute([weak = weak_from_this(), handles = std::move(copy)] {
+            auto self = weak.lock();
+            if (!self) return;
+            for (auto& batch : self->batchesOf(handles)) self->sendNearby(std::move(batch), false);
+        });
+    }
+
+    // 按GeoId和区块分组，每组至多maxShapesPerPacket个图形；已移除或隐藏的图形被跳过
+    std::vector<Batch> batchesOf(std::span<Handle const> handles) const {
+        struct Item {
+            GeoId    id;
+            ChunkKey key;
+            Vec3     pos;
+            Handle   handle;
+        };
+        std::vector<Item> items;
+        items.reserve(handles.size());
+        {
+            std::shared_lock l{poolMutex};
+            std::shared_lock h{hiddenMutex};
+            for (auto handle : handles) {
+                auto shape = shapes.get(handle);
+                if (!shape) continue; // 发送前已被移除
+                if (hidden.contains(shape->owner.value)) continue;
+                auto key = keyOf(shape->payload);
+                if (!key) continue;
+                items.emplace_back(shape->owner, *key, shape->payload.mLocation->value(), handle);
+            }
+        }
+        auto order = [](Item const& item) {
+            return std::tuple{
+                item.id.value,
+                item.key.second,
+                item.key.first.x,
+                item.key.first.z,
+                item.handle.index
+            };
+        };
+        std::sort(items.begin(), items.end(), [&](auto& a, auto& b) {
+            return order(a) < order(b);
+        });
+        items.erase(
+            std::unique(
+                items.begin(),
+                items.end(),
+                [](auto& a, auto& b) { return a.handle == b.handle; }
+            ),
+            items.end()
+        );
+
+        std::vector<Batch> res;
+        for (size_t i = 0; i < items.size(); i++) {
+            auto& item = items[i];
+            if (i == 0 || !(items[i - 1].id == item.id) || !(items[i - 1].key == item.key)
+                || res.back().handles.size() >= maxShapesPerPacket) {
+                res.push_back({item.id, item.pos, item.key.second, {}});
+            }
+            res.back().handles.push_back(item.handle);
+        }
+        return res;
+    }
+
+    std::shared_ptr<DebugDrawerPacket> build(std::span<Handle const> handles) const {
+        auto packet = std::make_shared<DebugDrawerPacket>();
+        packet->setSerializationMode(SerializationMode::CerealOnly);
+        packet->mShapes->reserve(handles.size());
+        std::shared_lock l{poolMutex};
+        std::shared_lock h{hiddenMutex};
+        for (auto handle : handles) {
+            auto shape = shapes.get(handle);
+            if (shape && !hidden.contains(shape->owner.value)) {
+                packet->mShapes->push_back(shape->payload);
+            }
+        }
+        if (packet->mShapes->empty()) return nullptr;
+        return packet;
+    }
+
+    // 排队期间被移除或隐藏的图形不会再被发出
+    SendScheduler::Builder builder(std::vector<Handle>&& handles) {
+        return [weak = weak_from_this(), handles = std::move(handles)] {
+            auto self = weak.lock();
+            return self ? std::shared_ptr<Packet const>{self->build(handles)} : nullptr;
+        };
+    }
+
+    // scheduled为false时跳过SendScheduler直接发送
+    void sendNearby(Batch&& batch, bool scheduled = true) {
+        if (viewers) {
+            viewers->forEach(batch.dim, [&](Player& player) {
+                auto const& netId = player.getNetworkIdentifier();
+                sendToClient(Batch{batch}, netId, player.getClientSubId(), scheduled);
+            });
+            return;
+        }
+        if (scheduled && SendScheduler::enabled()) {
+            SendScheduler::getInstance()
+                .enqueueNearby(batch.id, builder(std::move(batch.handles)), batch.pos, batch.dim);
+            return;
+        }
+        if (auto packet = build(batch.handles)) {
+            PacketSink::get().sendTo(batch.id, *packet, batch.pos, batch.dim);
+        }
+    }
+
+    void sendToClient(
+        Batch&&                  batch,
+        NetworkIdentifier const& netId,
+        SubClientId              subId,
+        bool                     scheduled = true
+    ) {
+        if (scheduled && SendScheduler::enabled()) {
+            SendScheduler::getInstance().enqueueClient(
+                batch.id,
+                builder(std::move(batch.handles)),
+                batch.pos,
+                netId,
+                subId
+            );
+            return;
+        }
+        if (auto packet = build(batch.handles)) {
+            PacketSink::get().sendToClient(batch.id, *packet, netId, subId);
+        }
+    }
+
+    using RemovePackets = std::vector<std::shared_ptr<DebugDrawerPacket>>;
+
+    // 所有图形合在少数几个包里移除
+    static void addRemoval(RemovePackets& packets, ShapeDataPayload&& shape) {
+        if (packets.empty() || packets.back()->mShapes->size() >= maxShapesPerPacket) {
+            auto& packet = packets.emplace_back(std::make_shared<DebugDrawerPacket>());
+            packet->setSerializationMode(SerializationMode::CerealOnly);
+        }
+        auto& removal      = packets.back()->mShapes->emplace_back(std::move(shape));
+        removal.mShapeType = std::nullopt;
+    }
+
+    void sendRemovals(GeoId id, RemovePackets&& packets) const {
+        if (packets.empty()) return;
+        metrics::execute([id, packets = std::move(packets), viewers = viewers] {
+            for (auto& packet : packets) {
+                if (viewers) {
+                    viewers->sendToAll(id, *packet);
+                } else {
+                    PacketSink::get().sendToClients(id, *packet);
+                }
+            }
+        });
+    }
+
+    static void addKey(std::vector<ChunkKey>& keys, ShapeDataPayload const& shape) {
+        auto key = keyOf(shape);
+        if (key && std::find(keys.begin(), keys.end(), *key) == keys.end()) keys.push_back(*key);
+    }
+
+    // 用于比较两个图形是否相同，只在update时使用
+    static std::string encode(ShapeDataPayload const& shape) {
+        DebugDrawerPacket packet;
+        packet.setSerializationMode(SerializationMode::CerealOnly);
+        packet.mShapes->push_back(shape);
+        SnapshotWriter writer;
+        writer.write(packet);
+        return writer.data();
+    }
+
+    bool isHidden(GeoId id) const {
+        std::shared_lock l{hiddenMutex};
+        return hidden.contains(id.value);
+    }
+
+    bool setVisible(GeoId id, bool visible) {
+        Handles handles;
+        if (!geoShapes.if_contains(id, [&handles](auto const& iter) { handles = iter.second; })) {
+            return false;
+        }
+        {
+            std::unique_lock l{hiddenMutex};
+            if (visible ? hidden.erase(id.value) == 0 : !hidden.insert(id.value).second) {
+                return true;
+            }
+        }
+        if (visible) {
+            queueSend(handles.span());
+            return true;
+        }
+        RemovePackets removePackets;
+        {
+            std::shared_lock l{poolMutex};
+            for (auto handle : handles.span()) {
+                if (auto shape = shapes.get(handle)) {
+                    addRemoval(removePackets, ShapeDataPayload{shape->payload});
+                }
+            }
+        }
+        sendRemovals(id, std::move(removePackets));
+        return true;
+    }
+
+    // 移除图形并通知客户端，不处理配方记录
+    void discard(GeoId id) {
+        {
+            std::unique_lock l{hiddenMutex};
+            hidden.erase(id.value);
+        }
+        Handles handles;
+        geoShapes.erase_if(id, [&handles](auto&& iter) {
+            handles = std::move(iter.second);
+            return true;
+        });
+        if (handles.empty()) return;
+
+        RemovePackets         removePackets;
+        std::vector<ChunkKey> keys;
+        {
+            std::unique_lock l{poolMutex};
+            for (auto handle : handles.span()) {
+                auto shape = shapes.get(handle);
+                if (!shape) continue;
+                addKey(keys, shape->payload);
+                addRemoval(removePackets, std::move(shape->payload));
+                shapes.erase(handle);
+            }
+        }
+        for (auto& key : keys) unindex(key, id);
+        sendRemovals(id, std::move(removePackets));
+    }
+
+    // 整个池一次释放，所有维度的移除合在同一批包里发给全部客户端，
+    // 玩家离开维度后客户端仍保留那里的图形，所以不能只发给当前维度的玩家
+    size_t clear() {
+        std::unique_lock c{clearMutex};
+        RemovePackets    removePackets;
+        size_t           res{};
+        {
+            std::unique_lock l{poolMutex};
+            res = shapes.size();
+            shapes.forEach([&removePackets](Shape& shape) {
+                addRemoval(removePackets, std::move(shape.payload));
+            });
+            shapes.clear();
+        }
+        geoShapes.clear();
+        {
+            std::shared_lock l{indexMutex};
+            for (auto& [dim, chunks] : chunkShapes) chunks->clear();
+        }
+        {
+            std::lock_guard l{pendingMutex};
+            pending.clear();
+        }
+        {
+            std::unique_lock l{hiddenMutex};
+            hidden.clear();
+        }
+        sendRemovals(GeoId::invalid(), std::move(removePackets));
+        return res;
+    }
+
+    // 把source的图形按顺序写到target已有的图形上并沿用其networkId，
+    // 只发送内容变化的图形，多出的旧图形移除，多出的新图形归到target名下
+    bool patch(GeoId target, GeoId source) {
+        if (!geoShapes.contains(target)) return false;
+        Handles fresh;
+        geoShapes.erase_if(source, [&fresh](auto&& iter) {
+            fresh = std::move(iter.second);
+            return true;
+        });
+        if (fresh.empty()) return false;
+
+        return geoShapes.modify_if(target, [&](auto&& iter) {
+            RemovePackets         removePackets;
+            std::vector<ChunkKey> targetKeys, sourceKeys;
+            std::vector<Handle>   changed;
+            Handles               result;
+            ll::ConcurrentDenseMap<ChunkKey, Handles> temMap;
+            {
+                std::unique_lock l{poolMutex};
+                auto live = [this](Handles const& handles) {
+                    std::vector<Handle> res;
+                    for (auto handle : handles.span()) {
+                        if (shapes.get(handle)) res.push_back(handle);
+                    }
+                    return res;
+                };
+                auto before = live(iter.second);
+                auto after  = live(fresh);
+                for (auto handle : before) addKey(targetKeys, shapes.get(handle)->payload);
+                for (auto handle : after) addKey(sourceKeys, shapes.get(handle)->payload);
+
+                size_t const common = std::min(before.size(), after.size());
+                for (size_t i = 0; i < common; i++) {
+                    auto& oldShape = shapes.get(before[i])->payload;
+                    auto& newShape = shapes.get(after[i])->payload;
+                    newShape.mNetworkId = *oldShape.mNetworkId;
+                    if (encode(oldShape) != encode(newShape)) {
+                        oldShape = std::move(newShape);
+                        changed.push_back(before[i]);
+                    }
+                    shapes.erase(after[i]);
+                    result.push_back(before[i]);
+                }
+                for (size_t i = common; i < before.size(); i++) {
+                    addRemoval(removePackets, std::move(shapes.get(before[i])->payload));
+                    shapes.erase(before[i]);
+                }
+                for (size_t i = common; i < after.size(); i++) {
+                    shapes.get(after[i])->owner = target;
+                    changed.push_back(after[i]);
+                    result.push_back(after[i]);
+                }
+                for (auto handle : result.span()) {
+                    if (auto key = keyOf(shapes.get(handle)->payload)) {
+                        auto [it, inserted] = temMap.try_emplace(*key);
+                        it->second.push_back(handle);
+                    }
+                }
+            }
+
+            for (auto& key : sourceKeys) unindex(key, source);
+            for (auto& key : targetKeys) unindex(key, target);
+            for (auto& [key, handles] : temMap) index(key, target, std::move(handles));
+            iter.second = std::move(result);
+
+            sendRemovals(target, std::move(removePackets));
+            if (!changed.empty()) queueSend(changed);
+        });
+    }
+
+    // 把ids中的图形归到newId名下，newId此前不能存在
+    bool absorb(GeoId newId, std::span<GeoId const> ids) {
+        Handles handles; // 合并后的图形
+        for (auto& id : ids) {
+            geoShapes.erase_if(id, [&handles](auto&& iter) {
+                handles.append(std::move(iter.second));
+                return true;
+            });
+        }
+        if (handles.empty()) return false;
+
+        ll::ConcurrentDenseMap<ChunkKey, std::vector<GeoId>> temMap; // 各区块中待合并的旧GeoId
+        {
+            std::unique_lock l{poolMutex};
+            for (auto handle : handles.span()) {
+                auto shape = shapes.get(handle);
+                if (!shape) continue;
+                if (auto key = keyOf(shape->payload)) {
+                    auto [iter, inserted] = temMap.try_emplace(*key);
+                    if (iter->second.empty() || !(iter->second.back() == shape->owner))
+                        iter->second.emplace_back(shape->owner);
+                }
+                shape->owner = newId;
+            }
+        }
+
+        // 处理chunkShapes
+        for (auto& [key, oldIds] : temMap) {
+            auto chunks = chunksIn(key.second);
+            if (!chunks) continue;
+            Handles moved;
+            chunks->modify_if(key.first, [&oldIds, &moved](auto&& iter) {
+                for (auto& id : oldIds) {
+                    auto it = std::lower_bound(
+                        iter.second.begin(),
+                        iter.second.end(),
+                        id,
+                        compareByGeoId
+                    );
+                    if (it != iter.second.end() && it->first == id) {
+                        moved.append(std::move(it->second));
+                        iter.second.erase(it);
+                    }
+                }
+            });
+            if (!moved.empty()) index(key, newId, std::move(moved));
+        }
+
+        geoShapes.emplace(newId, std::move(handles));
+
+        return true;
+    }
+
+    bool indexes(ChunkKey const& key) const {
+        auto chunks = chunksIn(key.second);
+        return chunks && chunks->contains(key.first);
+    }
+
+    size_t replay(ChunkKey const& key, NetworkIdentifier const& netId, SubClientId subId) {
+        if (viewers && !viewers->contains(netId, subId)) return 0;
+        auto chunks = chunksIn(key.second);
+        if (!chunks) return 0;
+        std::vector<Batch> batches;
+        chunks->erase_if(key.first, [&](auto&& iter) {
+            std::shared_lock l{poolMutex};
+            std::shared_lock h{hiddenMutex};
+            std::erase_if(iter.second, [&](auto&& pair) {
+                pair.second.erase_if([&](Handle handle) { return !shapes.get(handle); });
+                if (hidden.contains(pair.first.value)) return pair.second.empty();
+                for (auto handle : pair.second.span()) {
+                    if (batches.empty() || !(batches.back().id == pair.first)
+                        || batches.back().handles.size() >= maxShapesPerPacket) {
+                        auto& pos = shapes.get(handle)->payload.mLocation->value();
+                        batches.emplace_back(pair.first, pos, key.second);
+                    }
+                    batches.back().handles.push_back(handle);
+                }
+                return pair.second.empty();
+            });
+            return iter.second.empty();
+        });
+        // 补发已由pumpReplays按replayPacketsPerTick限量，直接发送，不再经过SendScheduler排队
+        size_t res{};
+        for (auto& batch : batches) {
+            if (auto packet = build(batch.handles)) {
+                PacketSink::get().sendToClient(batch.id, *packet, netId, subId);
+                ++res;
             }
         }
-        // else {
-        //     geoGroup.emplace(
-        //         geoId,
-        //         std::make_pair(std::vector<std::shared_ptr<DebugDrawerPacket>>{}, true)
-        //     );
-        // }
+        return res;
+    }
+
+    // 新加入的观看者补发全部图形，被移出的观看者移除全部图形
+    void onViewer(NetworkIdentifier const& netId, SubClientId subId, bool added) {
+        // 先不持有poolMutex复制出各GeoId的句柄，与shift、patch的加锁顺序保持一致
+        std::vector<HandlePair> owned;
+        geoShapes.for_each([&](auto const& iter) {
+            if (!isHidden(iter.first)) owned.emplace_back(iter.first, iter.second);
+        });
+        std::vector<Batch> batches;
+        RemovePackets      removePackets;
+        {
+            std::shared_lock l{poolMutex};
+            for (auto& [id, handles] : owned) {
+                for (auto handle : handles.span()) {
+                    auto shape = shapes.get(handle);
+                    if (!shape) continue;
+                    if (!added) {
+                        addRemoval(removePackets, ShapeDataPayload{shape->payload});
+                        continue;
+                    }
+                    auto key = keyOf(shape->payload);
+                    if (!key) continue;
+                    if (batches.empty() || !(batches.back().id == id)
+                        || batches.back().handles.size() >= maxShapesPerPacket) {
+                        batches.emplace_back(id, shape->payload.mLocation->value(), key->second);
+                    }
+                    batches.back().handles.push_back(handle);
+                }
+            }
+        }
+        for (auto& batch : batches) sendToClient(std::move(batch), netId, subId);
+        for (auto& packet : removePackets) {
+            PacketSink::get().sendToClient(GeoId::invalid(), *packet, netId, subId);
+        }
     }
 };
 
@@ -93,6 +732,39 @@ static std::recursive_mutex              listMutex;
 static std::vector<DebugDrawingHandler*> list;
 static std::atomic_bool                  hasInstance{false};
 
+// 已发给客户端、等待补发图形的区块
+struct ChunkVisit {
+    std::pair<ChunkPos, int> key;
+    NetworkIdentifier        netId;
+    SubClientId              subId;
+};
+static std::mutex             visitMutex;
+static std::deque<ChunkVisit> visits;
+static bool                   replaying{}; // visitMutex保护，补发监听不在时不再记录区块
+static ll::event::ListenerPtr replayListener;
+
+// 按区块加载顺序补发，一个区块的包总是在同一tick发完
+static void pumpReplays() {
+    auto const budget =
+        BedrockServerClientInterface::getInstance().getConfig().debugDraw.replayPacketsPerTick;
+    size_t sent{};
+    while (budget == 0 || sent < budget) {
+        std::optional<ChunkVisit> visit;
+        {
+            std::lock_guard l{visitMutex};
+            if (visits.empty()) break;
+            visit.emplace(std::move(visits.front()));
+            visits.pop_front();
+        }
+        sent += DebugDrawingHandler::replayChunk(
+            visit->key.first,
+            visit->key.second,
+            visit->netId,
+            visit->subId
+        );
+    }
+}
+
 LL_TYPE_INSTANCE_HOOK(
     DebugDrawingHandler::Impl::Hook,
     ll::memory::HookPriority::Normal,
@@ -104,50 +776,104 @@ LL_TYPE_INSTANCE_HOOK(
     ::SubClientId              recipientSubId
 ) {
     if (packet.getId() == MinecraftPacketIds::FullChunkData && hasInstance) [[unlikely]] {
-
+        metrics::ScopedTimer timer{metrics::Counter::ChunkHookNanos};
+        metrics::add(metrics::Counter::ChunkHookCalls);
         const auto& levelChunkPacket = static_cast<LevelChunkPacket const&>(packet);
-        const auto& chunkPos         = levelChunkPacket.mPos;
-        const auto& dimId            = (int)*levelChunkPacket.mDimensionId;
-        auto        key              = std::make_pair(chunkPos, dimId);
+        DebugDrawingHandler::queueReplay(
+            levelChunkPacket.mPos,
+            (int)*levelChunkPacket.mDimensionId,
+            id,
+            recipientSubId
+        );
+    }
+    origin(id, packet, recipientSubId);
+};
 
-        std::vector<std::shared_ptr<DebugDrawerPacket>> _chunkPackets;
+size_t DebugDrawingHandler::replayChunk(
+    ChunkPos const&          chunkPos,
+    DimensionType            dim,
+    NetworkIdentifier const& netId,
+    SubClientId              subId
+) {
+    auto key = std::make_pair(chunkPos, (int)dim);
 
-        {
-            std::lock_guard l{listMutex};
-
-            for (auto s : list) {
-                s->impl->chunkPackets.erase_if(key, [&_chunkPackets](auto&& iter) {
-                    std::erase_if(iter.second, [&_chunkPackets](auto&& packetPair) {
-                        _chunkPackets.reserve(_chunkPackets.size() + packetPair.second.size());
-                        std::erase_if(packetPair.second, [&_chunkPackets](auto&& pkt) {
-                            if (auto shared = pkt.lock()) {
-                                _chunkPackets.emplace_back(shared);
-                                return false;
-                            }
-                            return true;
-                        });
-                        return packetPair.second.empty();
-                    });
-                    return iter.second.empty();
-                });
-            }
-        }
-        for (auto& pkt : _chunkPackets) {
-            if (pkt) pkt->sendToClient(id, recipientSubId);
+    size_t          res{};
+    std::lock_guard l{listMutex};
+    for (auto s : list) res += s->impl->replay(key, netId, subId);
+    return res;
+}
+
+void DebugDrawingHandler::queueReplay(
+    ChunkPos const&          chunkPos,
+    DimensionType            dim,
+    NetworkIdentifier const& netId,
+    SubClientId              subId
+) {
+    auto key = std::make_pair(chunkPos, (int)dim);
+    {
+        // 没有任何实例在该区块中有图形时不必排队
+        std::lock_guard l{listMutex};
+        if (std::none_of(list.begin(), list.end(), [&](auto s) { return s->impl->indexes(key); })) {
+            return;
         }
     }
-    origin(id, packet, recipientSubId);
-};
+    std::lock_guard l{visitMutex};
+    if (!replaying) return;
+    visits.emplace_back(key, netId, subId);
+}
+
+void DebugDrawingHandler::startReplays() {
+    if (replayListener) return;
+    replayListener =
+        ll::event::EventBus::getInstance().emplaceListener<ll::event::world::ServerLevelTickEvent>(
+            [](ll::event::world::ServerLevelTickEvent&) { pumpReplays(); }
+        );
+    std::lock_guard l{visitMutex};
+    replaying = true;
+}
+
+void DebugDrawingHandler::stopReplays() {
+    if (!replayListener) return;
+    {
+        std::lock_guard l{visitMutex};
+        replaying = false;
+        visits.clear();
+    }
+    ll::event::EventBus::getInstance().removeListener<ll::event::world::ServerLevelTickEvent>(
+        replayListener
+    );
+    replayListener.reset();
+}
+
+DebugDrawingHandler::DebugDrawingHandler() : DebugDrawingHandler(nullptr) {}
 
-DebugDrawingHandler::DebugDrawingHandler() : impl(std::make_unique<Impl>()) {
+DebugDrawingHandler::DebugDrawingHandler(std::shared_ptr<ViewerSet> viewers)
+: impl(std::make_shared<Impl>()) {
+    if (viewers) {
+        impl->viewers     = std::move(viewers);
+        impl->viewerToken = impl->viewers->subscribe(
+            [weak = std::weak_ptr{impl}](Player& player, bool added) {
+                // 监听在增删观看者的线程上调用，收集和发送都转到服务端线程进行
+                metrics::execute([weak,
+                                  netId = player.getNetworkIdentifier(),
+                                  subId = player.getClientSubId(),
+                                  added] {
+                    if (auto self = weak.lock()) self->onViewer(netId, subId, added);
+                });
+            }
+        );
+    }
     static ll::memory::HookRegistrar<DebugDrawingHandler::Impl::Hook> reg;
-    std::lock_guard                                                   l{listMutex};
+    std::lock_guard l{listMutex};
     hasInstance = true;
     impl->id    = list.size();
     list.push_back(this);
 }
 
 DebugDrawingHandler::~DebugDrawingHandler() {
+    delist();
+    if (clearsOnDestroy()) clear();
+    if (impl->viewers) impl->viewers->unsubscribe(impl->viewerToken);
     std::lock_guard l{listMutex};
     list.back()->impl->id = impl->id;
     std::swap(list[impl->id], list.back());
@@ -163,44 +889,54 @@ GeometryGroup::GeoId DebugDrawingHandler::line(
     std::optional<float> /*thickness*/
 ) {
     if (begin == end) return GeoId::invalid();
+    LineSeg const segment{begin, end};
+    return emitLines(dim, {&segment, 1}, color);
+}
 
-    Vec3   offset = end - begin;
-    double len    = offset.length();
-    if (len <= shapeDisplayRadius + 0.5) { // 防止浮点误差导致的无限递归
-        auto packet = std::make_shared<DebugDrawerPacket>();
-        packet->setSerializationMode(SerializationMode::CerealOnly);
-        ShapeDataPayload shape;
-        shape.mNetworkId        = nextId_.fetch_sub(1);
-        shape.mShapeType        = ScriptModuleDebugUtilities::ScriptDebugShapeType::Line;
-        shape.mLocation         = begin;
-        shape.mColor            = color;
-        shape.mDimensionId      = dim;
-        shape.mExtraDataPayload = LineDataPayload{.mEndLocation = end};
-        packet->mShapes->emplace_back(std::move(shape));
-        ll::thread::ServerThreadExecutor::getDefault().execute([packet, begin, dim] {
-            packet->sendTo(begin, dim);
-        });
-
-        auto id = getNextGeoId();
-        impl->addPacket(id, packet, dim, begin);
-        return id;
-    }
-
-    int segmentNum   = ((int)len) / shapeDisplayRadius + 1;
-    offset          /= segmentNum;
-    Vec3 currentPos  = begin;
-    Vec3 lastPos     = begin;
+static ShapeDataPayload
+lineShape(DimensionType dim, Vec3 const& begin, Vec3 const& end, mce::Color const& color) {
+    ShapeDataPayload shape;
+    shape.mNetworkId        = nextId_.fetch_sub(1);
+    shape.mShapeType        = ScriptModuleDebugUtilities::ScriptDebugShapeType::Line;
+    shape.mLocation         = begin;
+    shape.mColor            = color;
+    shape.mDimensionId      = dim;
+    shape.mExtraDataPayload = LineDataPayload{.mEndLocation = end};
+    return shape;
+}
 
-    std::vector<GeoId> ids;
-    ids.reserve(segmentNum);
-    for (int i = 0; i < segmentNum - 1; i++) {
-        currentPos += offset;
-        ids.emplace_back(line(dim, lastPos, currentPos, color));
-        lastPos = currentPos;
+GeometryGroup::GeoId DebugDrawingHandler::emitLines(
+    DimensionType            dim,
+    std::span<LineSeg const> segments,
+    mce::Color const&        color,
+    std::optional<float> /*thickness*/
+) {
+    std::vector<ShapeDataPayload> batch;
+    batch.reserve(segments.size());
+    for (auto& [begin, end] : segments) {
+        if (begin == end) continue;
+        // 超出显示距离的线段等分，否则离得远的玩家看不到
+        Vec3   offset = end - begin;
+        double len    = offset.length();
+        if (len <= shapeDisplayRadius + 0.5) {
+            batch.push_back(lineShape(dim, begin, end, color));
+            continue;
+        }
+        int segmentNum  = ((int)len) / shapeDisplayRadius + 1;
+        offset         /= segmentNum;
+        Vec3 lastPos    = begin;
+        for (int i = 0; i < segmentNum - 1; i++) {
+            Vec3 currentPos = lastPos + offset;
+            batch.push_back(lineShape(dim, lastPos, currentPos, color));
+            lastPos = currentPos;
+        }
+        batch.push_back(lineShape(dim, lastPos, end, color)); // 避免浮点误差
     }
-    ids.emplace_back(line(dim, currentPos, end, color)); // 避免浮点误差
+    if (batch.empty()) return GeoId::invalid();
 
-    return merge(ids);
+    auto const id = impl->add(getNextGeoId(), std::move(batch));
+    place(id, dim, segments, 0);
+    return id;
 }
 
 GeometryGroup::GeoId DebugDrawingHandler::box(
@@ -212,8 +948,6 @@ GeometryGroup::GeoId DebugDrawingHandler::box(
     if ((box.max - box.min).lengthSqr() >= shapeDisplayRadius * shapeDisplayRadius)
         return Base::box(dim, box, color, thickness);
 
-    auto packet = std::make_shared<DebugDrawerPacket>();
-    packet->setSerializationMode(SerializationMode::CerealOnly);
     ShapeDataPayload shape;
     shape.mNetworkId        = nextId_.fetch_sub(1);
     shape.mShapeType        = ScriptModuleDebugUtilities::ScriptDebugShapeType::Box;
@@ -221,14 +955,7 @@ GeometryGroup::GeoId DebugDrawingHandler::box(
     shape.mColor            = color;
     shape.mDimensionId      = dim;
     shape.mExtraDataPayload = BoxDataPayload{.mBoxBound = box.max - box.min};
-    packet->mShapes->emplace_back(std::move(shape));
-    ll::thread::ServerThreadExecutor::getDefault().execute([packet, begin = box.min, dim] {
-        packet->sendTo(begin, dim);
-    });
-
-    auto id = getNextGeoId();
-    impl->addPacket(id, packet, dim, box.min);
-    return id;
+    return add(std::move(shape));
 }
 
 
@@ -241,13 +968,17 @@ GeometryGroup::GeoId DebugDrawingHandler::circle(
     std::optional<float> thickness
 ) {
     auto const& config = BedrockServerClientInterface::getInstance().getConfig().debugDraw;
+    RecordScope scope;
+    auto        recipe = circleRecipe(dim, center, normal, radius, color, thickness);
 
     if (radius > shapeDisplayRadius || !config.useNativeCircle) {
-        return Base::circle(dim, center, normal, radius, color, thickness);
+        return remember(
+            scope,
+            Base::circle(dim, center, normal, radius, color, thickness),
+            std::move(recipe)
+        );
     }
 
-    auto packet = std::make_shared<DebugDrawerPacket>();
-    packet->setSerializationMode(SerializationMode::CerealOnly);
     ShapeDataPayload shape;
     shape.mNetworkId   = nextId_.fetch_sub(1);
     shape.mShapeType   = ScriptModuleDebugUtilities::ScriptDebugShapeType::Circle;
@@ -256,14 +987,7 @@ GeometryGroup::GeoId DebugDrawingHandler::circle(
     shape.mScale       = radius;
     shape.mColor       = color;
     shape.mDimensionId = dim;
-    packet->mShapes->emplace_back(std::move(shape));
-    ll::thread::ServerThreadExecutor::getDefault().execute([packet, begin = center, dim] {
-        packet->sendTo(begin, dim);
-    });
-
-    auto id = getNextGeoId();
-    impl->addPacket(id, packet, dim, center);
-    return id;
+    return remember(scope, add(std::move(shape)), std::move(recipe));
 }
 
 GeometryGroup::GeoId DebugDrawingHandler::sphere(
@@ -274,14 +998,17 @@ GeometryGroup::GeoId DebugDrawingHandler::sphere(
     std::optional<float> thickness
 ) {
     auto const& config = BedrockServerClientInterface::getInstance().getConfig().debugDraw;
+    RecordScope scope;
+    auto        recipe = sphereRecipe(dim, center, radius, color, thickness);
 
     if (radius > shapeDisplayRadius || !config.useNativeSphere) {
-        return Base::sphere(dim, center, radius, color, thickness);
+        return remember(
+            scope,
+            Base::sphere(dim, center, radius, color, thickness),
+            std::move(recipe)
+        );
     }
 
-
-    auto packet = std::make_shared<DebugDrawerPacket>();
-    packet->setSerializationMode(SerializationMode::CerealOnly);
     ShapeDataPayload shape;
     shape.mNetworkId   = nextId_.fetch_sub(1);
     shape.mShapeType   = ScriptModuleDebugUtilities::ScriptDebugShapeType::Sphere;
@@ -292,14 +1019,7 @@ GeometryGroup::GeoId DebugDrawingHandler::sphere(
     if (config.sphereSegments.has_value()) {
         shape.mExtraDataPayload = SphereDataPayload{.mNumSegments = config.sphereSegments.value()};
     }
-    packet->mShapes->emplace_back(std::move(shape));
-    ll::thread::ServerThreadExecutor::getDefault().execute([packet, begin = center, dim] {
-        packet->sendTo(begin, dim);
-    });
-
-    auto id = getNextGeoId();
-    impl->addPacket(id, packet, dim, center);
-    return id;
+    return remember(scope, add(std::move(shape)), std::move(recipe));
 }
 
 GeometryGroup::GeoId DebugDrawingHandler::arrow(
@@ -312,11 +1032,12 @@ GeometryGroup::GeoId DebugDrawingHandler::arrow(
 ) {
     if (begin == end) return GeoId::invalid();
 
+    RecordScope scope;
+    auto recipe = arrowRecipe(dim, begin, end, color, mArrowHeadLength, mArrowHeadRadius);
+
     Vec3   offset = end - begin;
     double len    = offset.length();
     if (len <= shapeDisplayRadius + 0.5) { // 防止浮点误差导致的无限递归
-        auto packet = std::make_shared<DebugDrawerPacket>();
-        packet->setSerializationMode(SerializationMode::CerealOnly);
         auto const&      config = BedrockServerClientInterface::getInstance().getConfig().debugDraw;
         ShapeDataPayload shape;
         shape.mNetworkId        = nextId_.fetch_sub(1);
@@ -330,14 +1051,7 @@ GeometryGroup::GeoId DebugDrawingHandler::arrow(
             .mArrowHeadRadius = mArrowHeadRadius,
             .mNumSegments     = config.arrowSegments
         };
-        packet->mShapes->emplace_back(std::move(shape));
-        ll::thread::ServerThreadExecutor::getDefault().execute([packet, begin, dim] {
-            packet->sendTo(begin, dim);
-        });
-
-        auto id = getNextGeoId();
-        impl->addPacket(id, packet, dim, begin);
-        return id;
+        return remember(scope, add(std::move(shape)), std::move(recipe));
     }
 
     int segmentNum                 = ((int)len) / shapeDisplayRadius + 1;
@@ -352,7 +1066,50 @@ GeometryGroup::GeoId DebugDrawingHandler::arrow(
         lastPos = currentPos;
     }
     ids.emplace_back(arrow(dim, currentPos, end, color, mArrowHeadLength, mArrowHeadRadius));
-    return merge(ids);
+    return remember(scope, merge(ids), std::move(recipe));
+}
+
+GeometryGroup::GeoId DebugDrawingHandler::points(
+    DimensionType               dim,
+    std::span<Vec3 const>       points,
+    std::span<mce::Color const> colors,
+    std::optional<float>        radius,
+    std::optional<float>        cellSize
+) {
+    auto const samples = decimate(points, colors, cellSize);
+    if (samples.empty()) return GeoId::invalid();
+
+    auto const r = radius.value_or(
+        BedrockServerClientInterface::getInstance().getConfig().particle.defaultPointRadius
+    );
+    Vec3 const half{r, r, r};
+    auto const id = getNextGeoId();
+    AABB       bounds{samples.front().pos, samples.front().pos};
+
+    std::vector<ShapeDataPayload> batch;
+    batch.reserve(samples.size());
+    for (auto& sample : samples) {
+        ShapeDataPayload shape;
+        shape.mNetworkId        = nextId_.fetch_sub(1);
+        shape.mShapeType        = ScriptModuleDebugUtilities::ScriptDebugShapeType::Box;
+        shape.mLocation         = sample.pos;
+        shape.mColor            = sample.color;
+        shape.mDimensionId      = dim;
+        shape.mExtraDataPayload = BoxDataPayload{.mBoxBound = half * 2};
+        bounds                  = SpatialIndex::unite(bounds, {sample.pos, sample.pos});
+        batch.push_back(std::move(shape));
+    }
+    impl->add(id, std::move(batch));
+    place(id, dim, {bounds.min - half, bounds.max + half});
+    return id;
+}
+
+GeometryGroup::GeoId DebugDrawingHandler::add(ShapeDataPayload&& shape) {
+    auto const bounds = Impl::boundsOf(shape);
+    auto const dim    = shape.mDimensionId->value();
+    auto const id     = impl->add(getNextGeoId(), std::move(shape));
+    place(id, dim, bounds);
+    return id;
 }
 
 GeometryGroup::GeoId DebugDrawingHandler::text(
@@ -362,8 +1119,6 @@ GeometryGroup::GeoId DebugDrawingHandler::text(
     mce::Color const&    color,
     std::optional<float> scale
 ) {
-    auto packet = std::make_shared<DebugDrawerPacket>();
-    packet->setSerializationMode(SerializationMode::CerealOnly);
     ShapeDataPayload shape;
     shape.mNetworkId   = nextId_.fetch_sub(1);
     shape.mShapeType   = ScriptModuleDebugUtilities::ScriptDebugShapeType::Text;
@@ -374,217 +1129,155 @@ GeometryGroup::GeoId DebugDrawingHandler::text(
     TextDataPayload extraDataPayload;
     extraDataPayload.mText  = std::move(text);
     shape.mExtraDataPayload = std::move(extraDataPayload);
-    packet->mShapes->emplace_back(std::move(shape));
-    ll::thread::ServerThreadExecutor::getDefault().execute([packet, begin = pos, dim] {
-        packet->sendTo(begin, dim);
+    return add(std::move(shape));
+}
+
+GeometryGroup::Stats DebugDrawingHandler::stats() const {
+    Stats res{"debugDraw"};
+    res.geoIds         = impl->geoShapes.size();
+    res.chunkIndexSize = impl->indexSize();
+    std::shared_lock l{impl->poolMutex};
+    res.primitives = impl->shapes.size();
+    return res;
+}
+
+// 格式：重复{GeoId, 包数, 包...}，以GeoId 0结尾
+bool DebugDrawingHandler::save(SnapshotWriter& writer) const {
+    std::vector<std::pair<GeoId, std::vector<Impl::Handle>>> entries;
+    impl->geoShapes.for_each([&entries](auto const& iter) {
+        auto handles = iter.second.span();
+        entries.emplace_back(iter.first, std::vector<Impl::Handle>{handles.begin(), handles.end()});
     });
+    for (auto& [id, handles] : entries) {
+        std::vector<std::shared_ptr<DebugDrawerPacket>> packets;
+        for (size_t i = 0; i < handles.size(); i += maxShapesPerPacket) {
+            auto count = std::min(maxShapesPerPacket, handles.size() - i);
+            if (auto packet = impl->build(std::span{handles}.subspan(i, count))) {
+                packets.push_back(std::move(packet));
+            }
+        }
+        if (packets.empty()) continue;
+        writer.write(id.value);
+        writer.write((uint32_t)packets.size());
+        for (auto& packet : packets) writer.write(*packet);
+    }
+    writer.write(GeoId::invalid().value);
+    return true;
+}
 
-    auto id = getNextGeoId();
-    impl->addPacket(id, packet, dim, pos);
-    return id;
+bool DebugDrawingHandler::load(SnapshotReader& reader) {
+    GeoId last{};
+    for (;;) {
+        GeoId    id{};
+        uint32_t count{};
+        if (!reader.read(id.value)) return false;
+        if (id.value == 0) break;
+        if (!reader.read(count)) return false;
+        for (uint32_t i = 0; i < count; i++) {
+            DebugDrawerPacket packet;
+            packet.setSerializationMode(SerializationMode::CerealOnly);
+            if (!reader.read(packet)) return false;
+            for (auto& shape : *packet.mShapes) {
+                if (shape.mDimensionId->has_value()) {
+                    place(id, shape.mDimensionId->value(), Impl::boundsOf(shape));
+                }
+                impl->restore(id, std::move(shape));
+            }
+        }
+        last.value = std::max(last.value, id.value);
+    }
+    reserveGeoIds(last);
+    return true;
 }
 
 bool DebugDrawingHandler::remove(GeoId id) {
     if (id.value == 0) {
         return false;
     }
-    std::vector<std::shared_ptr<DebugDrawerPacket>> removePackets;
-    impl->geoPackets.erase_if(id, [this, id, &removePackets](auto&& iter) {
-        for (auto& packet : iter.second) {
-            if (packet && !packet->mShapes->empty() && (*packet->mShapes)[0].mLocation->has_value()
-                && (*packet->mShapes)[0].mDimensionId->has_value()) {
-                auto chunkPos = ChunkPos((*packet->mShapes)[0].mLocation->value());
-                auto dimId    = (int)(*packet->mShapes)[0].mDimensionId->value();
-                auto key      = std::make_pair(chunkPos, dimId);
-                impl->chunkPackets.erase_if(key, [this, id](auto&& iter) {
-                    auto it = std::lower_bound(
-                        iter.second.begin(),
-                        iter.second.end(),
-                        id,
-                        impl->compareByGeoId
-                    );
-                    if (it != iter.second.end() && it->first.value == id.value) {
-                        iter.second.erase(it);
-                    }
-                    return iter.second.empty();
-                });
-            }
-        }
-        removePackets = std::move(iter.second);
-        return true;
-    });
-    for (auto& packet : removePackets) {
-        ll::thread::ServerThreadExecutor::getDefault().execute([packet] {
-            if (packet) {
-                for (auto& shape : *packet->mShapes) shape.mShapeType = std::nullopt;
-                packet->sendToClients();
-            }
-        });
-    }
+    forget(id);
+    impl->discard(id);
     return true;
 }
 
+size_t DebugDrawingHandler::clear() {
+    GeometryGroup::clear();
+    return impl->clear();
+}
+
 GeometryGroup::GeoId DebugDrawingHandler::merge(std::span<GeoId> ids) {
     if (ids.empty()) {
         return GeoId::invalid();
     }
-    ll::ConcurrentDenseMap<std::pair<ChunkPos, int>,
-                           std::vector<GeoId>>      temMap;     // 用来处理包的合并
-    std::vector<std::shared_ptr<DebugDrawerPacket>> newPackets; // 合并后的包队列
-
-    // 移出旧id的geoPackets
+    auto newId = getNextGeoId();
+    regroup(newId, ids);
     for (auto& id : ids) {
-        impl->geoPackets.erase_if(id, [id, &temMap, &newPackets](auto&& iter) {
-            // 处理包的合并
-            std::erase_if(iter.second, [&temMap, id](auto&& packet) {
-                if (packet && !packet->mShapes->empty()
-                    && (*packet->mShapes)[0].mLocation->has_value()
-                    && (*packet->mShapes)[0].mDimensionId->has_value()) {
-                    auto chunkPos         = ChunkPos((*packet->mShapes)[0].mLocation->value());
-                    auto dimId            = (int)(*packet->mShapes)[0].mDimensionId->value();
-                    auto key              = std::make_pair(chunkPos, dimId);
-                    auto [iter, inserted] = temMap.try_emplace(key);
-
-                    // 记录对应区块待合并的GeoId
-                    iter->second.emplace_back(id);
-                    return false;
-                } else return true;
-            });
-            newPackets.insert(
-                newPackets.end(),
-                std::make_move_iterator(iter.second.begin()),
-                std::make_move_iterator(iter.second.end())
-            );
-            return true;
-        });
+        forget(id);
+        if (impl->isHidden(id)) impl->setVisible(id, true);
     }
-
-    if (newPackets.size() == 0) return GeoId::invalid();
-    auto newId = getNextGeoId();
-
-    // 处理chunkPackets
-    for (auto& [key, data] : temMap) {
-        impl->chunkPackets.modify_if(key, [this, &data, &newId](auto&& iter) {
-            // 合并包
-            std::vector<std::weak_ptr<DebugDrawerPacket>> pkts;
-            for (auto& id : data) {
-                auto it = std::lower_bound(
-                    iter.second.begin(),
-                    iter.second.end(),
-                    id,
-                    impl->compareByGeoId
-                );
-                if (it != iter.second.end() && it->first.value == id.value) {
-                    pkts.insert(
-                        pkts.end(),
-                        std::make_move_iterator(it->second.begin()),
-                        std::make_move_iterator(it->second.end())
-                    );
-                    iter.second.erase(it);
-                }
-            }
-            // 添加新的包
-            std::pair<GeoId, std::vector<std::weak_ptr<DebugDrawerPacket>>> newPair =
-                std::make_pair(newId, std::move(pkts));
-            auto it = std::lower_bound(
-                iter.second.begin(),
-                iter.second.end(),
-                newId,
-                impl->compareByGeoId
-            );
-            iter.second.insert(it, std::move(newPair));
-        });
+    if (!impl->absorb(newId, ids)) {
+        forget(newId);
+        return GeoId::invalid();
     }
+    return newId;
+}
 
-    // 添加新id的geoPackets
-    impl->geoPackets.emplace(newId, std::move(newPackets));
+bool DebugDrawingHandler::replace(GeoId target, GeoId source) {
+    if (target.value == 0 || source.value == 0) return false;
+    // source已经按可见发出，target原先隐藏时恢复隐藏并从客户端移除
+    auto const hidden = impl->isHidden(target);
+    impl->discard(target);
+    if (!impl->absorb(target, {&source, 1})) return false;
+    if (hidden) impl->setVisible(target, false);
+    return true;
+}
 
-    return newId;
+bool DebugDrawingHandler::patch(GeoId target, GeoId source) {
+    if (target.value == 0 || source.value == 0) return false;
+    return impl->patch(target, source);
 }
 
 bool DebugDrawingHandler::shift(GeoId id, Vec3 const& v) {
     if (id.value == 0) return false;
 
-    return impl->geoPackets.modify_if(id, [this, id, v](auto&& iter) {
-        ll::ConcurrentDenseMap<
-            std::pair<ChunkPos, int>,
-            std::vector<std::weak_ptr<DebugDrawerPacket>>>
-            temMap; // 用来处理shape跨区块
+    moved(id, v);
+    return impl->geoShapes.modify_if(id, [this, id, v](auto&& iter) {
+        ll::ConcurrentDenseMap<Impl::ChunkKey, Impl::Handles> temMap; // 用来处理shape跨区块
 
-        std::erase_if(iter.second, [&temMap, &v](auto&& packet) {
-            if (packet && !packet->mShapes->empty() && (*packet->mShapes)[0].mLocation->has_value()
-                && (*packet->mShapes)[0].mDimensionId->has_value()) {
-                auto chunkPos = ChunkPos((*packet->mShapes)[0].mLocation->value());
-                auto dimId    = (int)(*packet->mShapes)[0].mDimensionId->value();
+        {
+            std::unique_lock l{impl->poolMutex};
+            for (auto handle : iter.second.span()) {
+                auto shape = impl->shapes.get(handle);
+                if (!shape) continue;
+                auto& payload = shape->payload;
+                auto  key     = Impl::keyOf(payload);
+                if (!key) continue;
 
                 // 插入空值，用于标记原区块
-                temMap.try_emplace(std::make_pair(chunkPos, dimId));
-
-                // 处理移动后的包
-                for (auto& shape : *packet->mShapes) {
-                    if (shape.mLocation->has_value()) {
-                        shape.mLocation->value() += v;
-                        if (std::holds_alternative<ArrowDataPayload>(*shape.mExtraDataPayload)) {
-                            std::get<ArrowDataPayload>(*shape.mExtraDataPayload)
-                                .mEndLocation->value() += v;
-                        } else if (std::holds_alternative<LineDataPayload>(*shape.mExtraDataPayload
-                                   )) {
-                            *std::get<LineDataPayload>(*shape.mExtraDataPayload).mEndLocation += v;
-                        }
-                    }
+                temMap.try_emplace(*key);
+
+                payload.mLocation->value() += v;
+                if (std::holds_alternative<ArrowDataPayload>(*payload.mExtraDataPayload)) {
+                    std::get<ArrowDataPayload>(*payload.mExtraDataPayload)
+                        .mEndLocation->value() += v;
+                } else if (std::holds_alternative<LineDataPayload>(*payload.mExtraDataPayload)) {
+                    *std::get<LineDataPayload>(*payload.mExtraDataPayload).mEndLocation += v;
                 }
-                auto newChunkPos    = ChunkPos((*packet->mShapes)[0].mLocation->value());
-                auto [it, inserted] = temMap.try_emplace(std::make_pair(newChunkPos, dimId));
-                it->second.emplace_back(std::weak_ptr<DebugDrawerPacket>(packet));
-                return false;
+                auto [it, inserted] = temMap.try_emplace(*Impl::keyOf(payload));
+                it->second.push_back(handle);
             }
-            return true;
-        });
+        }
 
-        // 此时，temMap中数据为空代表需要删除该区块中的对应geoId的数据；否则为增改
+        // 此时，temMap中数据为空代表需要删除该区块中的对应geoId的数据；否则为替换
         for (auto& [key, data] : temMap) {
-            if (data.empty()) {
-                // 删
-                impl->chunkPackets.erase_if(key, [&id, this](auto&& iter) {
-                    auto it = std::lower_bound(
-                        iter.second.begin(),
-                        iter.second.end(),
-                        id,
-                        impl->compareByGeoId
-                    );
-                    if (it != iter.second.end() && it->first.value == id.value)
-                        iter.second.erase(it);
-                    return iter.second.empty();
-                });
-            }
-            // 增改
-            else {
-                auto [it, inserted] = impl->chunkPackets.try_emplace(key);
-                if (inserted) {
-                    it->second.emplace_back(id, std::move(data));
-                } else {
-                    auto _it = std::lower_bound(
-                        it->second.begin(),
-                        it->second.end(),
-                        id,
-                        impl->compareByGeoId
-                    );
-                    if (_it != it->second.end() && _it->first.value == id.value)
-                        _it->second = std::move(data);
-                    else it->second.emplace(_it, id, std::move(data));
-                }
-            }
+            impl->unindex(key, id);
+            if (!data.empty()) impl->index(key, id, std::move(data));
         }
-        for (auto& pkt : iter.second)
-            ll::thread::ServerThreadExecutor::getDefault().execute([pkt] {
-                if (pkt && !pkt->mShapes->empty() && (*pkt->mShapes)[0].mLocation->has_value()
-                    && (*pkt->mShapes)[0].mDimensionId->has_value()) {
-                    pkt->sendTo(
-                        (*pkt->mShapes)[0].mLocation->value(),
-                        (*pkt->mShapes)[0].mDimensionId->value()
-                    );
-                }
-            });
+        impl->sendShifted(iter.second.span());
     });
 }
-} // namespace bsci
\ No newline at end of file
+
+bool DebugDrawingHandler::setVisible(GeoId id, bool visible) {
+    if (id.value == 0) return false;
+    return impl->setVisible(id, visible);
+}
+} // namespace bsci
@@ -1,19 +1,53 @@
 #pragma once
 
 #include "bsci/GeometryGroup.h"
+#include "bsci/network/ViewerSet.h"
+
+#include <mc/network/NetworkIdentifier.h>
+#include <mc/network/packet/ShapeDataPayload.h>
+#include <mc/world/level/ChunkPos.h>
 
 namespace bsci {
 class DebugDrawingHandler : public GeometryGroup {
 private:
     class Impl;
-    std::unique_ptr<Impl> impl;
+    std::shared_ptr<Impl> impl;
 
     using Base = GeometryGroup;
 
+    // 交给impl保存并登记包围盒
+    GeoId add(ShapeDataPayload&& shape);
+
 public:
     DebugDrawingHandler();
+
+    // viewers不为空时只发给其中的玩家，成员变化时补发或移除全部图形
+    explicit DebugDrawingHandler(std::shared_ptr<ViewerSet> viewers);
+
     ~DebugDrawingHandler();
 
+    // 将该区块内所有实例的图形立即补发给指定客户端，返回发送的包数
+    static size_t replayChunk(
+        ChunkPos const&          chunkPos,
+        DimensionType            dim,
+        NetworkIdentifier const& netId,
+        SubClientId              subId
+    );
+
+    // 只记下区块已发给该客户端，之后每tick按debugDraw.replayPacketsPerTick补发
+    // 补发监听未注册或没有实例在该区块中有图形时直接忽略
+    static void queueReplay(
+        ChunkPos const&          chunkPos,
+        DimensionType            dim,
+        NetworkIdentifier const& netId,
+        SubClientId              subId
+    );
+
+    // 插件enable时注册、disable时移除每tick补发区块的监听，移除时丢弃尚未补发的区块
+    static void startReplays();
+
+    static void stopReplays();
+
 public:
     GeoId line(
         DimensionType        dim,
@@ -23,6 +57,14 @@ class DebugDrawingHandler : public GeometryGroup {
         std::optional<float> thickness = {}
     ) override;
 
+    // 所有线段一次登记、一次排队发送，挂在同一个GeoId下
+    GeoId emitLines(
+        DimensionType            dim,
+        std::span<LineSeg const> segments,
+        mce::Color const&        color     = mce::Color::WHITE(),
+        std::optional<float>     thickness = {}
+    ) override;
+
     GeoId
     box(DimensionType        dim,
         AABB const&          box,
@@ -63,10 +105,34 @@ class DebugDrawingHandler : public GeometryGroup {
          std::optional<float> scale = {}
      ) override;
 
+     Stats stats() const override;
+
+     bool save(SnapshotWriter& writer) const override;
+
+     bool load(SnapshotReader& reader) override;
+
+     // 每个点只用一个原生方块，全部挂在同一个GeoId下，不经过merge
+     GeoId points(
+         DimensionType               dim,
+         std::span<Vec3 const>       points,
+         std::span<mce::Color const> colors   = {},
+         std::optional<float>        radius   = {},
+         std::optional<float>        cellSize = {}
+     ) override;
+
      bool remove(GeoId) override;
 
+     size_t clear() override;
+
      GeoId merge(std::span<GeoId>) override;
 
      bool shift(GeoId, Vec3 const&) override;
+
+     bool setVisible(GeoId id, bool visible) override;
+
+protected:
+     bool replace(GeoId target, GeoId source) override;
+
+     bool patch(GeoId target, GeoId source) override;
 };
 } // namespace bsci
\ No newline at end of file
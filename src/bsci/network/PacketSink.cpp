@@ -0,0 +1,58 @@
+#include "bsci/network/PacketSink.h"
+#include "BedrockServerClientInterface.h"
+#include "bsci/utils/Metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <mc/deps/core/utility/BinaryStream.h>
+
+namespace bsci {
+
+static NetworkPacketSink        defaultSink;
+static std::atomic<PacketSink*> currentSink{&defaultSink};
+
+// 设置过的sink都不释放，其他线程从get()取得的引用在替换后仍然有效
+static std::mutex                               sinksMutex;
+static std::vector<std::shared_ptr<PacketSink>> sinks;
+
+PacketSink& PacketSink::get() { return *currentSink.load(std::memory_order_acquire); }
+
+void PacketSink::set(std::shared_ptr<PacketSink> sink) {
+    std::lock_guard l{sinksMutex};
+    currentSink.store(sink ? sink.get() : &defaultSink, std::memory_order_release);
+    if (sink && std::ranges::find(sinks, sink) == sinks.end()) sinks.push_back(std::move(sink));
+}
+
+static void count(Packet const& packet) {
+    metrics::add(metrics::Counter::PacketsSent);
+    if (BedrockServerClientInterface::getInstance().getConfig().stats.countBytes) {
+        BinaryStream stream;
+        packet.write(stream);
+        metrics::add(metrics::Counter::BytesSent, stream.getAndReleaseData().size());
+    }
+}
+
+void NetworkPacketSink::sendTo(GeoId, Packet const& packet, Vec3 const& pos, DimensionType dim) {
+    count(packet);
+    packet.sendTo(pos, dim);
+}
+
+void NetworkPacketSink::sendToClient(
+    GeoId,
+    Packet const&            packet,
+    NetworkIdentifier const& netId,
+    SubClientId              subId
+) {
+    count(packet);
+    packet.sendToClient(netId, subId);
+}
+
+void NetworkPacketSink::sendToClients(GeoId, Packet const& packet) {
+    count(packet);
+    packet.sendToClients();
+}
+
+} // namespace bsci
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "bsci/GeometryGroup.h"
+#include "bsci/Marcos.h"
+
+#include <memory>
+
+#include <mc/network/NetworkIdentifier.h>
+#include <mc/network/Packet.h>
+
+namespace bsci {
+// 所有几何包都经由PacketSink发出，默认实现直接转发到网络
+class PacketSink {
+public:
+    using GeoId = GeometryGroup::GeoId;
+
+    virtual ~PacketSink() = default;
+
+    virtual void sendTo(GeoId id, Packet const& packet, Vec3 const& pos, DimensionType dim) = 0;
+
+    virtual void sendToClient(
+        GeoId                    id,
+        Packet const&            packet,
+        NetworkIdentifier const& netId,
+        SubClientId              subId
+    ) = 0;
+
+    virtual void sendToClients(GeoId id, Packet const& packet) = 0;
+
+    BSCI_API static PacketSink& get();
+
+    // 传入空指针时恢复默认的NetworkPacketSink；被替换的sink一直保留到进程退出，
+    // 其他线程正在使用的引用不会失效
+    BSCI_API static void set(std::shared_ptr<PacketSink> sink);
+};
+
+class NetworkPacketSink : public PacketSink {
+public:
+    BSCI_API void sendTo(GeoId id, Packet const& packet, Vec3 const& pos, DimensionType dim) override;
+
+    BSCI_API void sendToClient(
+        GeoId                    id,
+        Packet const&            packet,
+        NetworkIdentifier const& netId,
+        SubClientId              subId
+    ) override;
+
+    BSCI_API void sendToClients(GeoId id, Packet const& packet) override;
+};
+} // namespace bsci
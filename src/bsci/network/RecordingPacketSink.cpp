@@ -0,0 +1,89 @@
+#include "bsci/network/RecordingPacketSink.h"
+
+#include <mc/deps/core/utility/BinaryStream.h>
+
+namespace bsci {
+
+RecordingPacketSink::RecordingPacketSink(std::shared_ptr<PacketSink> forward)
+: forward(std::move(forward)) {}
+
+void RecordingPacketSink::record(
+    GeoId              id,
+    Packet const&      packet,
+    std::optional<int> dim,
+    Recipient          recipient
+) {
+    BinaryStream stream;
+    packet.write(stream);
+    Traffic const traffic{1, stream.getAndReleaseData().size()};
+
+    std::lock_guard l{mutex};
+    totalTraffic                += traffic;
+    geoTraffic[id.value]        += traffic;
+    recipientTraffic[recipient] += traffic;
+    if (dim) {
+        geoDimension[id.value] = *dim;
+    } else if (auto it = geoDimension.find(id.value); it != geoDimension.end()) {
+        dim = it->second;
+    }
+    dimensionTraffic[dim.value_or(-1)] += traffic;
+}
+
+void RecordingPacketSink::sendTo(GeoId id, Packet const& packet, Vec3 const& pos, DimensionType dim) {
+    record(id, packet, (int)dim, {Recipient::Kind::Nearby});
+    if (forward) forward->sendTo(id, packet, pos, dim);
+}
+
+void RecordingPacketSink::sendToClient(
+    GeoId                    id,
+    Packet const&            packet,
+    NetworkIdentifier const& netId,
+    SubClientId              subId
+) {
+    record(id, packet, std::nullopt, recipientOf(netId, subId));
+    if (forward) forward->sendToClient(id, packet, netId, subId);
+}
+
+void RecordingPacketSink::sendToClients(GeoId id, Packet const& packet) {
+    record(id, packet, std::nullopt, {Recipient::Kind::All});
+    if (forward) forward->sendToClients(id, packet);
+}
+
+RecordingPacketSink::Traffic RecordingPacketSink::total() const {
+    std::lock_guard l{mutex};
+    return totalTraffic;
+}
+
+RecordingPacketSink::Traffic RecordingPacketSink::of(GeoId id) const {
+    std::lock_guard l{mutex};
+    auto            it = geoTraffic.find(id.value);
+    return it == geoTraffic.end() ? Traffic{} : it->second;
+}
+
+RecordingPacketSink::Traffic RecordingPacketSink::ofDimension(int dim) const {
+    std::lock_guard l{mutex};
+    auto            it = dimensionTraffic.find(dim);
+    return it == dimensionTraffic.end() ? Traffic{} : it->second;
+}
+
+RecordingPacketSink::Traffic RecordingPacketSink::ofRecipient(Recipient const& recipient) const {
+    std::lock_guard l{mutex};
+    auto            it = recipientTraffic.find(recipient);
+    return it == recipientTraffic.end() ? Traffic{} : it->second;
+}
+
+RecordingPacketSink::Recipient
+RecordingPacketSink::recipientOf(NetworkIdentifier const& netId, SubClientId subId) {
+    return {Recipient::Kind::Client, netId.getHash() * 31 + (uint64)subId};
+}
+
+void RecordingPacketSink::reset() {
+    std::lock_guard l{mutex};
+    totalTraffic = {};
+    geoTraffic.clear();
+    geoDimension.clear();
+    dimensionTraffic.clear();
+    recipientTraffic.clear();
+}
+
+} // namespace bsci
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "bsci/network/PacketSink.h"
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace bsci {
+// 序列化并统计每个包，可选地继续转发给另一个PacketSink
+class RecordingPacketSink : public PacketSink {
+public:
+    struct Traffic {
+        size_t packets{};
+        size_t bytes{};
+
+        Traffic& operator+=(Traffic const& other) {
+            packets += other.packets;
+            bytes   += other.bytes;
+            return *this;
+        }
+    };
+
+    struct Recipient {
+        enum class Kind : uchar {
+            Nearby, // sendTo，接收者由位置和维度决定
+            Client, // sendToClient
+            All,    // sendToClients
+        };
+        Kind   kind{};
+        uint64 hash{}; // Client时为NetworkIdentifier与SubClientId的哈希
+
+        constexpr bool operator==(Recipient const&) const = default;
+    };
+
+private:
+    struct RecipientHash {
+        size_t operator()(Recipient const& r) const {
+            return std::hash<uint64>{}(r.hash) ^ ((size_t)r.kind << 1);
+        }
+    };
+
+    std::shared_ptr<PacketSink>                           forward;
+    mutable std::mutex                                    mutex;
+    Traffic                                               totalTraffic;
+    std::unordered_map<uint64, Traffic>                   geoTraffic;
+    std::unordered_map<uint64, int>                       geoDimension;
+    std::unordered_map<int, Traffic>                      dimensionTraffic;
+    std::unordered_map<Recipient, Traffic, RecipientHash> recipientTraffic;
+
+    void record(GeoId id, Packet const& packet, std::optional<int> dim, Recipient recipient);
+
+public:
+    BSCI_API explicit RecordingPacketSink(std::shared_ptr<PacketSink> forward = nullptr);
+
+    BSCI_API void sendTo(GeoId id, Packet const& packet, Vec3 const& pos, DimensionType dim) override;
+
+    BSCI_API void sendToClient(
+        GeoId                    id,
+        Packet const&            packet,
+        NetworkIdentifier const& netId,
+        SubClientId              subId
+    ) override;
+
+    BSCI_API void sendToClients(GeoId id, Packet const& packet) override;
+
+    BSCI_API Traffic total() const;
+
+    BSCI_API Traffic of(GeoId id) const;
+
+    // sendToClient和sendToClients不带维度，按该GeoId最近一次sendTo的维度计入，未知则为-1
+    BSCI_API Traffic ofDimension(int dim) const;
+
+    BSCI_API Traffic ofRecipient(Recipient const& recipient) const;
+
+    BSCI_API static Recipient recipientOf(NetworkIdentifier const& netId, SubClientId subId);
+
+    BSCI_API void reset();
+};
+} // namespace bsci
@@ -0,0 +1,163 @@
+#include "bsci/network/SendScheduler.h"
+#include "BedrockServerClientInterface.h"
+#include "bsci/network/PacketSink.h"
+
+#include <algorithm>
+
+#include <ll/api/event/EventBus.h>
+#include <ll/api/event/world/ServerLevelTickEvent.h>
+#include <ll/api/service/Bedrock.h>
+
+#include <mc/deps/core/utility/BinaryStream.h>
+#include <mc/world/actor/player/Player.h>
+#include <mc/world/level/Level.h>
+
+namespace bsci {
+
+// 玩家移动超过该距离后重新计算队列优先级
+constexpr float reprioritizeDistance = 8.0f;
+
+constexpr auto heapCompare = [](auto const& a, auto const& b) {
+    return a.priority > b.priority || (a.priority == b.priority && a.seq > b.seq);
+};
+
+SendScheduler& SendScheduler::getInstance() {
+    static SendScheduler instance;
+    return instance;
+}
+
+uint64 SendScheduler::clientKey(NetworkIdentifier const& netId, SubClientId subId) {
+    return netId.getHash() * 31 + (uint64)subId;
+}
+
+bool SendScheduler::enabled() {
+    return BedrockServerClientInterface::getInstance().getConfig().budget.enabled;
+}
+
+void SendScheduler::enqueueNearby(GeoId id, Builder build, Vec3 const& pos, DimensionType dim) {
+    auto            job = std::make_shared<Job>(std::move(build));
+    std::lock_guard l{pendingMutex};
+    pending.emplace_back(id, std::move(job), pos, (int)dim);
+}
+
+void SendScheduler::enqueueClient(
+    GeoId                    id,
+    Builder                  build,
+    Vec3 const&              pos,
+    NetworkIdentifier const& netId,
+    SubClientId              subId
+) {
+    auto            job = std::make_shared<Job>(std::move(build));
+    std::lock_guard l{pendingMutex};
+    pending.emplace_back(id, std::move(job), pos, -1, netId, subId);
+}
+
+size_t SendScheduler::queued() {
+    size_t res{};
+    for (auto& [key, client] : clients) res += client.heap.size();
+    std::lock_guard l{pendingMutex};
+    return res + pending.size();
+}
+
+void SendScheduler::push(Client& client, GeoId id, std::shared_ptr<Job> job, Vec3 const& pos) {
+    client.heap.emplace_back(pos.distanceToSqr(client.origin), seq++, id, std::move(job), pos);
+    std::push_heap(client.heap.begin(), client.heap.end(), heapCompare);
+}
+
+void SendScheduler::pump() {
+    auto level = ll::service::getLevel();
+    if (!level) return;
+    auto const& config = BedrockServerClientInterface::getInstance().getConfig().budget;
+    ++pumps;
+
+    std::unordered_map<uint64, Player*> players;
+    level->forEachPlayer([&](Player& player) {
+        players.emplace(clientKey(player.getNetworkIdentifier(), player.getClientSubId()), &player);
+        return true;
+    });
+
+    std::vector<Pending> incoming;
+    {
+        std::lock_guard l{pendingMutex};
+        incoming.swap(pending);
+    }
+    auto const radiusSqr = (float)(config.nearbyRadius * config.nearbyRadius);
+    for (auto& p : incoming) {
+        if (p.netId) {
+            auto key = clientKey(*p.netId, p.subId);
+            auto it  = players.find(key);
+            if (it == players.end()) continue;
+            auto [iter, inserted] =
+                clients.try_emplace(key, *p.netId, p.subId, it->second->getPosition());
+            push(iter->second, p.id, std::move(p.job), p.pos);
+            continue;
+        }
+        for (auto& [key, player] : players) {
+            if ((int)player->getDimensionId() != p.dim
+                || player->getPosition().distanceToSqr(p.pos) > radiusSqr) {
+                continue;
+            }
+            auto [iter, inserted] = clients.try_emplace(
+                key,
+                player->getNetworkIdentifier(),
+                player->getClientSubId(),
+                player->getPosition()
+            );
+            push(iter->second, p.id, p.job, p.pos);
+        }
+    }
+
+    std::erase_if(clients, [&](auto& iter) {
+        auto& [key, client] = iter;
+        auto it             = players.find(key);
+        if (it == players.end()) return true; // 玩家已离线
+
+        auto const& pos = it->second->getPosition();
+        if (pos.distanceToSqr(client.origin) > reprioritizeDistance * reprioritizeDistance) {
+            client.origin = pos;
+            for (auto& entry : client.heap) entry.priority = entry.pos.distanceToSqr(pos);
+            std::make_heap(client.heap.begin(), client.heap.end(), heapCompare);
+        }
+
+        size_t packets{}, bytes{};
+        while (!client.heap.empty() && packets < config.packetsPerTick
+               && (config.bytesPerTick == 0 || bytes < config.bytesPerTick)) {
+            std::pop_heap(client.heap.begin(), client.heap.end(), heapCompare);
+            auto entry = std::move(client.heap.back());
+            client.heap.pop_back();
+            auto& job = *entry.job;
+            if (job.builtAt != pumps) {
+                job.packet  = job.build();
+                job.builtAt = pumps;
+            }
+            auto& packet = job.packet;
+            if (!packet) continue;
+            if (config.bytesPerTick != 0) {
+                BinaryStream stream;
+                packet->write(stream);
+                bytes += stream.getAndReleaseData().size();
+            }
+            PacketSink::get().sendToClient(entry.id, *packet, client.netId, client.subId);
+            ++packets;
+        }
+        return client.heap.empty();
+    });
+}
+
+void SendScheduler::start() {
+    if (listener) return;
+    listener =
+        ll::event::EventBus::getInstance().emplaceListener<ll::event::world::ServerLevelTickEvent>(
+            [this](ll::event::world::ServerLevelTickEvent&) { pump(); }
+        );
+}
+
+void SendScheduler::stop() {
+    if (!listener) return;
+    ll::event::EventBus::getInstance().removeListener<ll::event::world::ServerLevelTickEvent>(
+        listener
+    );
+    listener.reset();
+}
+
+} // namespace bsci
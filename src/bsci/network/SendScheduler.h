@@ -0,0 +1,90 @@
+#pragma once
+
+#include "bsci/GeometryGroup.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <ll/api/event/Listener.h>
+
+#include <mc/network/NetworkIdentifier.h>
+#include <mc/network/Packet.h>
+
+namespace bsci {
+// 按玩家限制每tick的发包量，距离玩家近的图形优先发送
+// 队列中只保存构建函数，轮到发送时才生成包，图形被移除后返回nullptr即被丢弃
+class SendScheduler {
+public:
+    using GeoId = GeometryGroup::GeoId;
+
+    // 在服务端线程调用，返回nullptr表示无需再发送
+    using Builder = std::function<std::shared_ptr<Packet const>()>;
+
+private:
+    struct Job {
+        Builder                       build;
+        std::shared_ptr<Packet const> packet;
+        uint64                        builtAt{}; // 同一tick内发给多个玩家时复用
+    };
+    struct Entry {
+        float                priority; // 与玩家距离的平方
+        uint64               seq;
+        GeoId                id;
+        std::shared_ptr<Job> job;
+        Vec3                 pos;
+    };
+    struct Pending {
+        GeoId                            id;
+        std::shared_ptr<Job>             job;
+        Vec3                             pos;
+        int                              dim;
+        std::optional<NetworkIdentifier> netId; // 为空时发给附近所有玩家
+        SubClientId                      subId{};
+    };
+    struct Client {
+        NetworkIdentifier  netId;
+        SubClientId        subId;
+        Vec3               origin; // 计算优先级时玩家所在位置
+        std::vector<Entry> heap;
+    };
+
+    std::mutex                         pendingMutex;
+    std::vector<Pending>               pending;
+    std::unordered_map<uint64, Client> clients; // 仅在服务端线程访问
+    uint64                             seq{};
+    uint64                             pumps{};
+    ll::event::ListenerPtr             listener;
+
+    void push(Client& client, GeoId id, std::shared_ptr<Job> job, Vec3 const& pos);
+
+public:
+    BSCI_API static SendScheduler& getInstance();
+
+    BSCI_API static uint64 clientKey(NetworkIdentifier const& netId, SubClientId subId);
+
+    BSCI_API static bool enabled();
+
+    // 可在任意线程调用，包会在下一tick分发到维度内附近的玩家
+    BSCI_API void enqueueNearby(GeoId id, Builder build, Vec3 const& pos, DimensionType dim);
+
+    // 可在任意线程调用
+    BSCI_API void enqueueClient(
+        GeoId                    id,
+        Builder                  build,
+        Vec3 const&              pos,
+        NetworkIdentifier const& netId,
+        SubClientId              subId
+    );
+
+    BSCI_API size_t queued();
+
+    void pump();
+
+    void start();
+
+    void stop();
+};
+} // namespace bsci
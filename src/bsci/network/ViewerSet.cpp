@@ -0,0 +1,103 @@
+#include "bsci/network/ViewerSet.h"
+#include "bsci/network/PacketSink.h"
+
+#include <algorithm>
+
+#include <ll/api/service/Bedrock.h>
+
+#include <mc/world/actor/player/Player.h>
+#include <mc/world/level/Level.h>
+
+namespace bsci {
+
+void ViewerSet::notify(Player& player, bool added) {
+    std::vector<Listener> copies;
+    {
+        std::lock_guard l{listenerMutex};
+        for (auto& [token, listener] : listeners) copies.push_back(listener);
+    }
+    for (auto& listener : copies) listener(player, added);
+}
+
+bool ViewerSet::add(Player& player) {
+    {
+        std::unique_lock l{mutex};
+        if (std::ranges::find(uuids, player.getUuid()) != uuids.end()) return false;
+        uuids.push_back(player.getUuid());
+    }
+    notify(player, true);
+    return true;
+}
+
+bool ViewerSet::remove(Player& player) {
+    {
+        std::unique_lock l{mutex};
+        auto             it = std::ranges::find(uuids, player.getUuid());
+        if (it == uuids.end()) return false;
+        uuids.erase(it);
+    }
+    notify(player, false);
+    return true;
+}
+
+bool ViewerSet::contains(Player const& player) const {
+    std::shared_lock l{mutex};
+    return std::ranges::find(uuids, player.getUuid()) != uuids.end();
+}
+
+bool ViewerSet::contains(NetworkIdentifier const& netId, SubClientId subId) const {
+    bool res{};
+    forEach(std::nullopt, [&](Player& player) {
+        res = res || (player.getNetworkIdentifier() == netId && player.getClientSubId() == subId);
+    });
+    return res;
+}
+
+size_t ViewerSet::size() const {
+    std::shared_lock l{mutex};
+    return uuids.size();
+}
+
+void ViewerSet::forEach(
+    std::optional<DimensionType>        dim,
+    std::function<void(Player&)> const& fn
+) const {
+    auto level = ll::service::getLevel();
+    if (!level) return;
+    std::vector<Player*> players;
+    {
+        std::shared_lock l{mutex};
+        for (auto& uuid : uuids) {
+            auto player = level->getPlayer(uuid);
+            if (!player || (dim && player->getDimensionId() != *dim)) continue;
+            players.push_back(player);
+        }
+    }
+    for (auto player : players) fn(*player);
+}
+
+size_t ViewerSet::subscribe(Listener listener) {
+    std::lock_guard l{listenerMutex};
+    listeners.emplace(++nextListener, std::move(listener));
+    return nextListener;
+}
+
+void ViewerSet::unsubscribe(size_t token) {
+    std::lock_guard l{listenerMutex};
+    listeners.erase(token);
+}
+
+void ViewerSet::sendTo(GeoId id, Packet const& packet, DimensionType dim) const {
+    forEach(dim, [&](Player& player) {
+        PacketSink::get()
+            .sendToClient(id, packet, player.getNetworkIdentifier(), player.getClientSubId());
+    });
+}
+
+void ViewerSet::sendToAll(GeoId id, Packet const& packet) const {
+    forEach(std::nullopt, [&](Player& player) {
+        PacketSink::get()
+            .sendToClient(id, packet, player.getNetworkIdentifier(), player.getClientSubId());
+    });
+}
+} // namespace bsci
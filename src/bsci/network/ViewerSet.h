@@ -0,0 +1,64 @@
+#pragma once
+
+#include "bsci/GeometryGroup.h"
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+#include <mc/network/NetworkIdentifier.h>
+#include <mc/network/Packet.h>
+#include <mc/platform/UUID.h>
+
+class Player;
+
+namespace bsci {
+// 限定图形组的观看者，按UUID记录，玩家重新上线后仍然有效，换维度时跟随
+// 成员通常只有几个，查找都是线性的
+class ViewerSet {
+public:
+    using GeoId = GeometryGroup::GeoId;
+
+    // added为false表示被移出
+    using Listener = std::function<void(Player& player, bool added)>;
+
+private:
+    mutable std::shared_mutex  mutex;
+    std::vector<mce::UUID>     uuids;
+    std::mutex                 listenerMutex;
+    std::map<size_t, Listener> listeners;
+    size_t                     nextListener{};
+
+    void notify(Player& player, bool added);
+
+public:
+    // 已在集合中时返回false
+    BSCI_API bool add(Player& player);
+
+    BSCI_API bool remove(Player& player);
+
+    BSCI_API bool contains(Player const& player) const;
+
+    BSCI_API bool contains(NetworkIdentifier const& netId, SubClientId subId) const;
+
+    BSCI_API size_t size() const;
+
+    // 对在线的观看者调用fn，给出dim时只包括该维度中的
+    BSCI_API void
+    forEach(std::optional<DimensionType> dim, std::function<void(Player&)> const& fn) const;
+
+    // 成员变化时在调用add、remove的线程上通知，返回用于取消的编号
+    BSCI_API size_t subscribe(Listener listener);
+
+    BSCI_API void unsubscribe(size_t token);
+
+    // 发给dim中的观看者，用于代替按位置发给附近所有玩家
+    BSCI_API void sendTo(GeoId id, Packet const& packet, DimensionType dim) const;
+
+    // 发给所有在线的观看者，用于代替发给全服
+    BSCI_API void sendToAll(GeoId id, Packet const& packet) const;
+};
+} // namespace bsci
@@ -1,18 +1,39 @@
 #include "bsci/particle/ParticleSpawner.h"
 #include "BedrockServerClientInterface.h"
+#include "bsci/network/PacketSink.h"
+#include "bsci/network/ViewerSet.h"
+#include "bsci/utils/Metrics.h"
+#include "bsci/utils/Math.h"
+#include "bsci/utils/Snapshot.h"
+#include "bsci/utils/SpatialIndex.h"
+#include "bsci/utils/StrokeFont.h"
 
 #include <ll/api/base/Containers.h>
 #include <ll/api/event/EventBus.h>
 #include <ll/api/event/Listener.h>
 #include <ll/api/event/world/ServerLevelTickEvent.h>
+#include <ll/api/memory/Hook.h>
 #include <ll/api/service/Bedrock.h>
 #include <ll/api/service/GamingStatus.h>
 #include <ll/api/thread/ServerThreadExecutor.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_set>
 #include <mc/deps/core/string/HashedString.h>
 #include <mc/deps/core/threading/Threading.h>
 #include <mc/legacy/ActorUniqueID.h>
+#include <mc/network/LoopbackPacketSender.h>
+#include <mc/network/MinecraftPacketIds.h>
+#include <mc/network/NetworkIdentifier.h>
+#include <mc/network/packet/LevelChunkPacket.h>
 #include <mc/network/packet/SpawnParticleEffectPacket.h>
 #include <mc/platform/threading/AssignedThread.h>
 #include <mc/util/MolangMemberArray.h>
@@ -25,7 +46,10 @@
 #include <mc/util/MolangVariableMap.h>
 #include <mc/util/MolangVariableSettings.h>
 #include <mc/util/Timer.h>
+#include <mc/world/actor/player/Player.h>
 #include <mc/world/level/BlockPos.h>
+#include <mc/world/level/ChunkPos.h>
+#include <mc/world/level/Level.h>
 #include <mc/world/level/dimension/Dimension.h>
 
 
@@ -44,12 +68,32 @@ namespace bsci {
 //     return std::make_unique<ParticleSpawner>();
 // }
 
-static void addTime(MolangVariableMap& var) {
+// 持久模式下每个子表每keepAliveTime秒才重发一次
+static size_t keepAliveTicks() {
     auto& config = BedrockServerClientInterface::getInstance().getConfig().particle;
-    var.setMolangVariable(
-        "variable.bsci_particle_lifetime",
-        (float)(config.extraTime + ((64.0 / 20.0) / (double)config.tablePerTick))
-    );
+    return std::max<size_t>(64, (size_t)(config.keepAliveTime * 20.0));
+}
+// 当前有玩家的维度
+static std::vector<int> occupiedDimensions() {
+    std::vector<int> res;
+    auto             level = ll::service::getLevel();
+    if (!level) return res;
+    level->forEachPlayer([&res](Player& player) {
+        auto dim = (int)player.getDimensionId();
+        if (std::ranges::find(res, dim) == res.end()) res.push_back(dim);
+        return true;
+    });
+    return res;
+}
+// 粒子的寿命要覆盖到下一次重发，随tablePerTick、keepAliveTime变化
+static double lifetimeOf(bool persistent) {
+    auto& config = BedrockServerClientInterface::getInstance().getConfig().particle;
+    return config.extraTime
+         + (persistent ? (double)keepAliveTicks() / 20.0
+                       : ((64.0 / 20.0) / (double)config.tablePerTick));
+}
+static void addTime(MolangVariableMap& var, bool persistent) {
+    var.setMolangVariable("variable.bsci_particle_lifetime", (float)lifetimeOf(persistent));
 }
 static void addSize(MolangVariableMap& var, Vec2 const& size) {
     var.setMolangVariable(
@@ -69,59 +113,647 @@ static void addDirection(MolangVariableMap& var, Vec3 const& dir) {
         MolangMemberArray{MolangStruct_XYZ{}, dir}
     );
 }
+static void addThickness(MolangVariableMap& var, std::optional<float> thickness) {
+    var.setMolangVariable(
+        "variable.bsci_particle_thickness",
+        thickness.value_or(
+            BedrockServerClientInterface::getInstance().getConfig().particle.defaultThickness
+        ) * 0.5f
+    );
+}
+static void addXYZ(MolangVariableMap& var, std::string const& name, Vec3 const& v) {
+    var.setMolangVariable(name, MolangMemberArray{MolangStruct_XYZ{}, v});
+}
+
+// 两点外扩margin后的包围盒，用于空间索引
+static AABB boundsOf(Vec3 const& a, Vec3 const& b, float margin) {
+    Vec3 const m{margin, margin, margin};
+    return SpatialIndex::unite({a - m, a + m}, {b - m, b + m});
+}
+
+// 与particles/ring.json中的事件数量一致
+constexpr size_t maxRingSegments = 64;
+
+// 与particles/polyline4.json中的事件数量一致，3段共4个点
+constexpr size_t maxPolylinePoints = 4;
+
+// scale为1时大写字母的高度
+constexpr float textHeight = 0.5f;
+
 struct ParticleSpawner::Impl {
-    std::atomic_bool       active{true};
-    size_t                 tickId{};
-    ll::event::ListenerPtr listener;
-    size_t                 id{};
-    ll::ConcurrentDenseMap<
-        GeoId,
-        std::unique_ptr<SpawnParticleEffectPacket>,
-        ::phmap::priv::hash_default_hash<GeoId>,
-        ::phmap::priv::hash_default_eq<GeoId>,
-        ::std::allocator<::std::pair<GeoId const, std::unique_ptr<SpawnParticleEffectPacket>>>,
-        6>
-                                                      geoPackets;
+    using ChunkKey = std::pair<ChunkPos, int>;
+    struct Hook;
+    // 客户端按速度自行移动的粒子，服务端重发前把位置校正到当前时刻
+    struct Drift {
+        Vec3                                  origin;
+        Vec3                                  velocity;
+        std::chrono::steady_clock::time_point start;
+    };
+    // 每个维度各自的存储，互不争用锁，重发进度也各自推进
+    struct Partition {
+        size_t tickId{};
+        ll::ConcurrentDenseMap<
+            GeoId,
+            std::unique_ptr<SpawnParticleEffectPacket>,
+            ::phmap::priv::hash_default_hash<GeoId>,
+            ::phmap::priv::hash_default_eq<GeoId>,
+            ::std::allocator<::std::pair<GeoId const, std::unique_ptr<SpawnParticleEffectPacket>>>,
+            6>
+            packets;
+        ll::ConcurrentDenseMap<ChunkPos, std::vector<GeoId>>
+            chunkParticles; // 仅持久模式使用，用于区块加载时补发
+    };
+    std::atomic_bool           active{true};
+    bool                       persistent{};
+    double                     lifetime{}; // 已有的包构造时写入的寿命
+    ll::event::ListenerPtr     listener;
+    size_t                     id{};
+    std::shared_ptr<ViewerSet> viewers; // 为空时发给所有玩家
+    size_t                     viewerToken{};
+
+    mutable std::shared_mutex                 partitionMutex;
+    std::map<int, std::unique_ptr<Partition>> partitions; // 只增不删，取出的指针一直有效
+    ll::ConcurrentDenseMap<GeoId, int>        dims;       // 粒子所在的维度
     ll::ConcurrentDenseMap<GeoId, std::vector<GeoId>> geoGroup;
+    ll::ConcurrentDenseMap<GeoId, Fill>               fills; // 从快照恢复的粒子没有
+    ll::ConcurrentDenseMap<GeoId, Drift>              drifts;
 
-    void sendParticleImmediately(SpawnParticleEffectPacket& pkt) {
-        if (BedrockServerClientInterface::getInstance().getConfig().particle.delayUndate) {
-            return;
+    mutable std::shared_mutex  hiddenMutex;
+    std::unordered_set<uint64> hidden; // 隐藏的GeoId及其下的粒子，不再发送
+
+    static inline std::mutex         listMutex;
+    static inline std::vector<Impl*> list;
+    static inline std::atomic_bool   hasPersistent{false};
+
+    // 已发给客户端、等待补发持久粒子的区块
+    struct ChunkVisit {
+        ChunkKey          key;
+        NetworkIdentifier netId;
+        SubClientId       subId;
+    };
+    static inline std::mutex             visitMutex;
+    static inline std::deque<ChunkVisit> visits;
+    static inline bool                   replaying{}; // visitMutex保护，监听不在时不再记录区块
+    static inline ll::event::ListenerPtr replayListener;
+
+    Partition* find(int dim) const {
+        std::shared_lock l{partitionMutex};
+        auto             it = partitions.find(dim);
+        return it == partitions.end() ? nullptr : it->second.get();
+    }
+
+    Partition& partition(int dim) {
+        if (auto p = find(dim)) return *p;
+        std::unique_lock l{partitionMutex};
+        auto&            p = partitions[dim];
+        if (!p) p = std::make_unique<Partition>();
+        return *p;
+    }
+
+    std::vector<std::pair<int, Partition*>> snapshot() const {
+        std::vector<std::pair<int, Partition*>> res;
+        std::shared_lock                        l{partitionMutex};
+        res.reserve(partitions.size());
+        for (auto& [dim, p] : partitions) res.emplace_back(dim, p.get());
+        return res;
+    }
+
+    std::string effectName(std::string_view shape, mce::Color const& color) const {
+        std::string name{"bsci:"};
+        if (persistent) name += "persistent_";
+        if (color.a != 1) name += "blend_";
+        name += shape;
+        return name;
+    }
+
+    // 复合粒子由子发射器绘制，寿命由变量控制，无需持久版本
+    static std::string compoundName(std::string_view shape, mce::Color const& color) {
+        std::string name{"bsci:"};
+        if (color.a != 1) name += "blend_";
+        name += shape;
+        return name;
+    }
+
+    void index(GeoId id, SpawnParticleEffectPacket const& pkt) {
+        if (!persistent) return;
+        partition(pkt.mVanillaDimensionId)
+            .chunkParticles.try_emplace_l(
+                ChunkPos(*pkt.mPos),
+                [id](auto&& iter) { iter.second.push_back(id); },
+                std::vector<GeoId>{id}
+            );
+    }
+
+    void unindex(GeoId id, SpawnParticleEffectPacket const& pkt) {
+        if (!persistent) return;
+        auto p = find(pkt.mVanillaDimensionId);
+        if (!p) return;
+        p->chunkParticles.erase_if(ChunkPos(*pkt.mPos), [id](auto&& iter) {
+            std::erase(iter.second, id);
+            return iter.second.empty();
+        });
+    }
+
+    template <class Fn>
+    bool modify(GeoId id, Fn&& fn) {
+        std::optional<int> dim;
+        dims.if_contains(id, [&dim](auto const& iter) { dim = iter.second; });
+        auto p = dim ? find(*dim) : nullptr;
+        return p && p->packets.modify_if(id, std::forward<Fn>(fn));
+    }
+
+    void put(GeoId id, std::unique_ptr<SpawnParticleEffectPacket> pkt) {
+        int const dim = pkt->mVanillaDimensionId;
+        index(id, *pkt);
+        dims.insert_or_assign(id, dim);
+        partition(dim).packets.insert_or_assign(id, std::move(pkt));
+    }
+
+    // 取出id对应的包，不影响fills与drifts
+    std::unique_ptr<SpawnParticleEffectPacket> take(GeoId id) {
+        std::optional<int> dim;
+        dims.erase_if(id, [&dim](auto&& iter) {
+            dim = iter.second;
+            return true;
+        });
+        auto p = dim ? find(*dim) : nullptr;
+        if (!p) return nullptr;
+        std::unique_ptr<SpawnParticleEffectPacket> res;
+        p->packets.erase_if(id, [&](auto&& iter) {
+            if (iter.second) unindex(id, *iter.second);
+            res = std::move(iter.second);
+            return true;
+        });
+        return res;
+    }
+
+    bool erase(GeoId id) {
+        fills.erase(id);
+        drifts.erase(id);
+        return take(id) != nullptr;
+    }
+
+    std::unique_ptr<SpawnParticleEffectPacket> build(
+        Vec3 const&        pos,
+        std::string const& name,
+        uchar              dim,
+        Fill const&        fill,
+        Vec3 const&        velocity = Vec3::ZERO()
+    ) const {
+        MolangVariableMap var;
+        fill(var);
+        addTime(var, persistent);
+        if (!(velocity == Vec3::ZERO())) addXYZ(var, "variable.bsci_motion_velocity", velocity);
+        return std::make_unique<SpawnParticleEffectPacket>(pos, name, dim, std::move(var));
+    }
+
+    std::vector<GeoId> members(GeoId id) const {
+        std::vector<GeoId> res;
+        if (!geoGroup.if_contains(id, [&res](auto const& iter) { res = iter.second; })) {
+            res.push_back(id);
         }
-        ll::thread::ServerThreadExecutor::getDefault().execute([pkt] {
-            pkt.sendTo(*pkt.mPos, pkt.mVanillaDimensionId);
+        return res;
+    }
+
+    bool canDrive(GeoId id) const {
+        return std::ranges::all_of(members(id), [this](GeoId sub) { return fills.contains(sub); });
+    }
+
+    // 把匀速运动的粒子的位置校正到当前时刻
+    void correct(GeoId id, SpawnParticleEffectPacket& pkt) {
+        std::optional<Vec3> pos;
+        drifts.if_contains(id, [&pos](auto const& iter) {
+            auto& drift   = iter.second;
+            auto  seconds = std::chrono::steady_clock::now() - drift.start;
+            pos = drift.origin + drift.velocity * std::chrono::duration<float>(seconds).count();
         });
+        if (!pos) return;
+        unindex(id, pkt);
+        *pkt.mPos = *pos;
+        index(id, pkt);
     }
 
-    void tick() {
-        if (!active.load(std::memory_order_acquire)) {
+    // 以新的速度重建id下的所有粒子，速度为0时停在当前位置
+    void drive(GeoId id, Vec3 const& velocity) {
+        auto const now = std::chrono::steady_clock::now();
+        for (auto& sub : members(id)) {
+            if (velocity == Vec3::ZERO() && !drifts.contains(sub)) continue;
+            modify(sub, [&](auto&& iter) {
+                if (!iter.second) return;
+                auto& pkt = *iter.second;
+                correct(sub, pkt);
+                drifts.erase(sub);
+                std::unique_ptr<SpawnParticleEffectPacket> packet;
+                fills.if_contains(sub, [&](auto const& fill) {
+                    packet = build(
+                        *pkt.mPos,
+                        *pkt.mEffectName,
+                        pkt.mVanillaDimensionId,
+                        fill.second,
+                        velocity
+                    );
+                });
+                if (!packet) return;
+                iter.second = std::move(packet);
+                if (!(velocity == Vec3::ZERO())) {
+                    drifts.insert_or_assign(sub, Drift{*iter.second->mPos, velocity, now});
+                }
+                sendParticleImmediately(id, *iter.second);
+            });
+        }
+    }
+
+    // 寿命在构造包时写入，重发间隔变化后按新的寿命重建所有包，否则粒子会在下一次重发前消失
+    // 从快照恢复的粒子没有fills，保持原来的寿命直到被重新绘制
+    void retime() {
+        auto const fresh = lifetimeOf(persistent);
+        if (fresh == std::exchange(lifetime, fresh)) return;
+        for (auto& [dim, p] : snapshot()) {
+            for (size_t i = 0; i < p->packets.subcnt(); i++) {
+                p->packets.with_submap_m(i, [&](auto& map) {
+                    for (auto& [id, pkt] : map) {
+                        if (!pkt) continue;
+                        auto velocity = Vec3::ZERO();
+                        drifts.if_contains(id, [&](auto const& iter) {
+                            velocity = iter.second.velocity;
+                        });
+                        fills.if_contains(id, [&](auto const& fill) {
+                            pkt = build(
+                                *pkt->mPos,
+                                *pkt->mEffectName,
+                                pkt->mVanillaDimensionId,
+                                fill.second,
+                                velocity
+                            );
+                        });
+                    }
+                });
+            }
+        }
+    }
+
+    size_t clear() {
+        size_t res{};
+        for (auto& [dim, p] : snapshot()) {
+            res += p->packets.size();
+            p->packets.clear();
+            p->chunkParticles.clear();
+        }
+        dims.clear();
+        geoGroup.clear();
+        fills.clear();
+        drifts.clear();
+        std::unique_lock l{hiddenMutex};
+        hidden.clear();
+        return res;
+    }
+
+    bool isHidden(GeoId id) const {
+        std::shared_lock l{hiddenMutex};
+        return hidden.contains(id.value);
+    }
+
+    // 客户端无法提前移除粒子，隐藏只是停止发送，已发出的粒子在寿命结束后消失
+    bool setVisible(GeoId id, bool visible) {
+        if (!geoGroup.contains(id) && !dims.contains(id)) return false;
+        auto const subs = members(id);
+        {
+            std::unique_lock l{hiddenMutex};
+            if (visible) {
+                if (hidden.erase(id.value) == 0) return true;
+                for (auto& sub : subs) hidden.erase(sub.value);
+            } else {
+                if (!hidden.insert(id.value).second) return true;
+                for (auto& sub : subs) hidden.insert(sub.value);
+            }
+        }
+        if (!visible) return true;
+        for (auto& sub : subs) {
+            modify(sub, [&](auto&& iter) {
+                if (!iter.second) return;
+                correct(sub, *iter.second);
+                sendParticleImmediately(sub, *iter.second);
+            });
+        }
+        return true;
+    }
+
+    bool discard(GeoId id) {
+        {
+            auto const       subs = members(id);
+            std::unique_lock l{hiddenMutex};
+            hidden.erase(id.value);
+            for (auto& sub : subs) hidden.erase(sub.value);
+        }
+        if (!geoGroup.erase_if(id, [this](auto&& iter) {
+                for (auto& subId : iter.second) {
+                    erase(subId);
+                }
+                return true;
+            })) {
+            return erase(id);
+        }
+        return true;
+    }
+
+    // 取出id对应的全部粒子，id本身失效
+    std::vector<GeoId> detach(GeoId id) {
+        std::vector<GeoId> res;
+        if (!geoGroup.erase_if(id, [&res](auto&& iter) {
+                res = std::move(iter.second);
+                return true;
+            })) {
+            res.push_back(id);
+        }
+        return res;
+    }
+
+    static std::string encode(SpawnParticleEffectPacket const& pkt) {
+        SnapshotWriter writer;
+        writer.write(pkt);
+        return writer.data();
+    }
+
+    // 按顺序用source的包替换target已有的包，只重发内容变化的
+    void patch(GeoId target, GeoId source) {
+        auto before = detach(target);
+        auto after  = detach(source);
+
+        std::vector<GeoId> res;
+        res.reserve(after.size());
+        size_t const common = std::min(before.size(), after.size());
+        for (size_t i = 0; i < common; i++) {
+            auto packet = take(after[i]);
+            if (!packet) continue;
+            drifts.erase(before[i]);
+            fills.erase(before[i]);
+            fills.erase_if(after[i], [&](auto&& iter) {
+                fills.try_emplace(before[i], std::move(iter.second));
+                return true;
+            });
+            // 新包可能换了维度，因此整体取出再放回
+            auto old = take(before[i]);
+            if (!old || encode(*old) != encode(*packet)) {
+                sendParticleImmediately(target, *packet);
+                old = std::move(packet);
+            }
+            put(before[i], std::move(old));
+            res.push_back(before[i]);
+        }
+        for (size_t i = common; i < before.size(); i++) erase(before[i]);
+        for (size_t i = common; i < after.size(); i++) {
+            modify(after[i], [&](auto&& iter) {
+                if (iter.second) sendParticleImmediately(target, *iter.second);
+            });
+            res.push_back(after[i]);
+        }
+        // 隐藏期间update的结果仍然隐藏
+        if (isHidden(target)) {
+            std::unique_lock l{hiddenMutex};
+            for (auto& sub : res) hidden.insert(sub.value);
+        }
+        if (res.size() != 1 || !(res.front() == target)) {
+            geoGroup.insert_or_assign(target, std::move(res));
+        }
+    }
+
+    bool indexes(ChunkKey const& key) const {
+        auto p = find(key.second);
+        return p && p->chunkParticles.contains(key.first);
+    }
+
+    // 返回发送的包数
+    size_t replayChunk(ChunkKey const& key, NetworkIdentifier const& netId, SubClientId subId) {
+        if (viewers && !viewers->contains(netId, subId)) return 0;
+        auto p = find(key.second);
+        if (!p) return 0;
+        std::vector<GeoId> ids;
+        p->chunkParticles.if_contains(key.first, [&ids](auto&& iter) { ids = iter.second; });
+        size_t res{};
+        for (auto& id : ids) {
+            if (isHidden(id)) continue;
+            p->packets.modify_if(id, [&](auto&& iter) {
+                if (!iter.second) return;
+                correct(id, *iter.second);
+                PacketSink::get().sendToClient(id, *iter.second, netId, subId);
+                ++res;
+            });
+        }
+        return res;
+    }
+
+    // 按区块加载顺序补发，一个区块的包总是在同一tick发完
+    static void pumpReplays() {
+        auto const budget =
+            BedrockServerClientInterface::getInstance().getConfig().particle.replayPacketsPerTick;
+        size_t sent{};
+        while (budget == 0 || sent < budget) {
+            std::optional<ChunkVisit> visit;
+            {
+                std::lock_guard l{visitMutex};
+                if (visits.empty()) break;
+                visit.emplace(std::move(visits.front()));
+                visits.pop_front();
+            }
+            std::lock_guard l{listMutex};
+            for (auto s : list) sent += s->replayChunk(visit->key, visit->netId, visit->subId);
+        }
+    }
+
+    void sendParticleImmediately(GeoId id, SpawnParticleEffectPacket& pkt) {
+        if (isHidden(id)) return;
+        // 持久模式下只在变化时发送，不能延迟到下一次保活
+        if (!persistent
+            && BedrockServerClientInterface::getInstance().getConfig().particle.delayUndate) {
             return;
         }
-        auto const tablePerTick =
-            BedrockServerClientInterface::getInstance().getConfig().particle.tablePerTick;
-        auto begin = (tickId % (64 / tablePerTick)) * tablePerTick;
-        for (size_t i = 0; i < tablePerTick; i++) {
-            geoPackets.with_submap(begin + i, [&](auto& map) {
+        metrics::execute([id, pkt, viewers = viewers] { send(viewers.get(), id, pkt); });
+    }
+
+    static void send(ViewerSet const* viewers, GeoId id, SpawnParticleEffectPacket const& pkt) {
+        if (viewers) {
+            viewers->sendTo(id, pkt, pkt.mVanillaDimensionId);
+        } else {
+            PacketSink::get().sendTo(id, pkt, *pkt.mPos, pkt.mVanillaDimensionId);
+        }
+    }
+
+    void sendSubmap(Partition& p, size_t idx) {
+        p.packets.with_submap_m(idx, [&](auto& map) {
+            std::shared_lock l{hiddenMutex};
+            for (auto& [id, pkt] : map) {
+                if (pkt && !hidden.contains(id.value)) {
+                    correct(id, *pkt);
+                    send(viewers.get(), id, *pkt);
+                }
+            }
+        });
+    }
+
+    // 有观看者时只考虑观看者所在的维度
+    std::vector<int> occupied() const {
+        if (!viewers) return occupiedDimensions();
+        std::vector<int> res;
+        viewers->forEach(std::nullopt, [&res](Player& player) {
+            auto dim = (int)player.getDimensionId();
+            if (std::ranges::find(res, dim) == res.end()) res.push_back(dim);
+        });
+        return res;
+    }
+
+    // 新观看者立即收到所在维度的粒子，不必等下一轮重发；移出的观看者等粒子自然消失
+    void onViewer(NetworkIdentifier const& netId, SubClientId subId, int dim, bool added) {
+        if (!added) return;
+        auto p = find(dim);
+        if (!p) return;
+        for (size_t i = 0; i < p->packets.subcnt(); i++) {
+            p->packets.with_submap_m(i, [&](auto& map) {
+                std::shared_lock l{hiddenMutex};
                 for (auto& [id, pkt] : map) {
-                    if (pkt) {
-                        pkt->sendTo(*pkt->mPos, pkt->mVanillaDimensionId);
-                    }
+                    if (!pkt || hidden.contains(id.value)) continue;
+                    correct(id, *pkt);
+                    PacketSink::get().sendToClient(id, *pkt, netId, subId);
                 }
             });
         }
-        ++tickId;
+    }
+
+    void tick() {
+        if (!active.load(std::memory_order_acquire)) {
+            return;
+        }
+        metrics::ScopedTimer timer{metrics::Counter::ResendTickNanos};
+        metrics::add(metrics::Counter::ResendTicks);
+        auto const dims = occupied();
+        for (auto& [dim, p] : snapshot()) {
+            // 没有玩家的维度既不重发也不推进进度，玩家进入后由区块补发或下一轮重发追上
+            if (std::ranges::find(dims, dim) == dims.end()) continue;
+            resend(*p);
+        }
+    }
+
+    void resend(Partition& p) {
+        if (persistent) {
+            auto const period = keepAliveTicks();
+            auto const phase  = p.tickId % period;
+            for (size_t i = phase * 64 / period; i < (phase + 1) * 64 / period; i++) {
+                sendSubmap(p, i);
+            }
+        } else {
+            auto const tablePerTick =
+                BedrockServerClientInterface::getInstance().getConfig().particle.tablePerTick;
+            auto begin = (p.tickId % (64 / tablePerTick)) * tablePerTick;
+            for (size_t i = 0; i < tablePerTick; i++) {
+                sendSubmap(p, begin + i);
+            }
+        }
+        ++p.tickId;
     }
 };
 
-ParticleSpawner::ParticleSpawner() : impl(std::make_shared<Impl>()) {
+LL_TYPE_INSTANCE_HOOK(
+    ParticleSpawner::Impl::Hook,
+    ll::memory::HookPriority::Normal,
+    LoopbackPacketSender,
+    &LoopbackPacketSender::$sendToClient,
+    void,
+    ::NetworkIdentifier const& id,
+    ::Packet const&            packet,
+    ::SubClientId              recipientSubId
+) {
+    origin(id, packet, recipientSubId);
+    if (packet.getId() == MinecraftPacketIds::FullChunkData && Impl::hasPersistent) [[unlikely]] {
+        metrics::ScopedTimer timer{metrics::Counter::ChunkHookNanos};
+        metrics::add(metrics::Counter::ChunkHookCalls);
+        auto const&          levelChunkPacket = static_cast<LevelChunkPacket const&>(packet);
+        ParticleSpawner::Impl::ChunkKey key{
+            levelChunkPacket.mPos,
+            (int)*levelChunkPacket.mDimensionId
+        };
+        // 这里只记下区块，补发由pumpReplays按tick限量进行；没有粒子的区块不排队
+        bool indexed{};
+        {
+            std::lock_guard l{Impl::listMutex};
+            indexed = std::ranges::any_of(Impl::list, [&key](auto s) { return s->indexes(key); });
+        }
+        if (!indexed) return;
+        std::lock_guard l{Impl::visitMutex};
+        if (Impl::replaying) Impl::visits.emplace_back(key, id, recipientSubId);
+    }
+};
+
+void ParticleSpawner::startReplays() {
+    if (Impl::replayListener) return;
+    Impl::replayListener =
+        ll::event::EventBus::getInstance().emplaceListener<ll::event::world::ServerLevelTickEvent>(
+            [](ll::event::world::ServerLevelTickEvent&) { Impl::pumpReplays(); }
+        );
+    std::lock_guard l{Impl::visitMutex};
+    Impl::replaying = true;
+}
+
+void ParticleSpawner::stopReplays() {
+    if (!Impl::replayListener) return;
+    {
+        std::lock_guard l{Impl::visitMutex};
+        Impl::replaying = false;
+        Impl::visits.clear();
+    }
+    ll::event::EventBus::getInstance().removeListener<ll::event::world::ServerLevelTickEvent>(
+        Impl::replayListener
+    );
+    Impl::replayListener.reset();
+}
+
+ParticleSpawner::ParticleSpawner()
+: ParticleSpawner(BedrockServerClientInterface::getInstance().getConfig().particle.persistent) {}
+
+ParticleSpawner::ParticleSpawner(bool persistent) : ParticleSpawner(persistent, nullptr) {}
+
+ParticleSpawner::ParticleSpawner(bool persistent, std::shared_ptr<ViewerSet> viewers)
+: impl(std::make_shared<Impl>()) {
+    impl->persistent = persistent;
+    impl->lifetime   = lifetimeOf(persistent);
+    if (viewers) {
+        impl->viewers     = std::move(viewers);
+        impl->viewerToken = impl->viewers->subscribe(
+            [weak = std::weak_ptr{impl}](Player& player, bool added) {
+                // 监听在增删观看者的线程上调用，补发转到服务端线程进行
+                metrics::execute([weak,
+                                  netId = player.getNetworkIdentifier(),
+                                  subId = player.getClientSubId(),
+                                  dim   = (int)player.getDimensionId(),
+                                  added] {
+                    if (auto self = weak.lock()) self->onViewer(netId, subId, dim, added);
+                });
+            }
+        );
+    }
+    if (persistent) {
+        static ll::memory::HookRegistrar<ParticleSpawner::Impl::Hook> reg;
+        std::lock_guard                                               l{Impl::listMutex};
+        Impl::hasPersistent = true;
+        impl->id            = Impl::list.size();
+        Impl::list.push_back(impl.get());
+    }
     impl->listener =
         ll::event::EventBus::getInstance().emplaceListener<ll::event::world::ServerLevelTickEvent>(
             [impl = impl](ll::event::world::ServerLevelTickEvent&) { impl->tick(); }
         );
 }
 ParticleSpawner::~ParticleSpawner() {
+    delist();
     if (impl) {
+        if (clearsOnDestroy()) clear();
         impl->active.store(false, std::memory_order_release);
+        if (impl->viewers) impl->viewers->unsubscribe(impl->viewerToken);
+        if (impl->persistent) {
+            std::lock_guard l{Impl::listMutex};
+            Impl::list.back()->id = impl->id;
+            std::swap(Impl::list[impl->id], Impl::list.back());
+            Impl::list.pop_back();
+            Impl::hasPersistent = !Impl::list.empty();
+        }
         if (impl->listener) {
             ll::event::EventBus::getInstance()
                 .removeListener<ll::event::world::ServerLevelTickEvent>(impl->listener);
@@ -133,15 +765,26 @@ ParticleSpawner::~ParticleSpawner() {
 GeometryGroup::GeoId ParticleSpawner::particle(
     DimensionType      dim,
     Vec3 const&        pos,
+    AABB const&        bounds,
     std::string const& name,
-    MolangVariableMap  var
-) const {
-    addTime(var);
-    auto packet =
-        std::make_unique<SpawnParticleEffectPacket>(pos, name, (uchar)dim, std::move(var));
-    impl->sendParticleImmediately(*packet);
-    auto id = GeometryGroup::getNextGeoId();
-    impl->geoPackets.try_emplace(id, std::move(packet));
+    Fill&&             fill
+) {
+    auto const id = spawn(dim, pos, name, std::move(fill));
+    place(id, dim, bounds);
+    return id;
+}
+
+GeometryGroup::GeoId ParticleSpawner::spawn(
+    DimensionType      dim,
+    Vec3 const&        pos,
+    std::string const& name,
+    Fill&&             fill
+) {
+    auto packet = impl->build(pos, name, (uchar)dim, fill);
+    auto id     = GeometryGroup::getNextGeoId();
+    if (!isStaging()) impl->sendParticleImmediately(id, *packet);
+    impl->fills.try_emplace(id, std::move(fill));
+    impl->put(id, std::move(packet));
     return id;
 }
 
@@ -153,22 +796,72 @@ GeometryGroup::GeoId ParticleSpawner::line(
     std::optional<float> thickness
 ) {
     if (begin == end) return GeoId::invalid();
-    MolangVariableMap var;
-    addSize(
-        var,
-        {begin.distanceTo(end),
-         thickness.value_or(
-             BedrockServerClientInterface::getInstance().getConfig().particle.defaultThickness
-         )}
-    );
-    addDirection(var, (end - begin).normalize());
-    addTint(var, color);
-    return particle(
-        dim,
-        (begin + end) * 0.5f,
-        color.a == 1 ? "bsci:line" : "bsci:blend_line",
-        std::move(var)
+    LineSeg const segment{begin, end};
+    return emitLines(dim, {&segment, 1}, color, thickness);
+}
+
+GeometryGroup::GeoId ParticleSpawner::emitLines(
+    DimensionType            dim,
+    std::span<LineSeg const> segments,
+    mce::Color const&        color,
+    std::optional<float>     thickness
+) {
+    auto const width = thickness.value_or(
+        BedrockServerClientInterface::getInstance().getConfig().particle.defaultThickness
     );
+    auto const name     = impl->effectName("line", color);
+    auto const polyName = Impl::compoundName("polyline4", color);
+
+    std::vector<GeoId> subs;
+    subs.reserve(segments.size());
+    // 首尾相接的线段每至多3段合为一个polyline4粒子，单独的一段仍用line
+    for (size_t i = 0; i < segments.size();) {
+        auto const& first = segments[i++];
+        if (first.begin == first.end) continue;
+        std::array<Vec3, maxPolylinePoints> dots{first.begin, first.end};
+        size_t                              count = 2;
+        for (; i < segments.size() && count < maxPolylinePoints; i++) {
+            auto const& next = segments[i];
+            if (!(next.begin == dots[count - 1])) break;
+            if (next.begin == next.end) continue;
+            dots[count++] = next.end;
+        }
+
+        if (count == 2) {
+            Vec2 const size{dots[0].distanceTo(dots[1]), width};
+            auto const direction = (dots[1] - dots[0]).normalize();
+            auto const center    = (dots[0] + dots[1]) * 0.5f;
+            subs.emplace_back(spawn(dim, center, name, [=](MolangVariableMap& var) {
+                addSize(var, size);
+                addDirection(var, direction);
+                addTint(var, color);
+            }));
+            continue;
+        }
+        // 其余的点相对第一个点，不足时重复最后一个点
+        std::array<Vec3, maxPolylinePoints - 1> offsets;
+        for (size_t k = 1; k < maxPolylinePoints; k++) {
+            offsets[k - 1] = dots[std::min(k, count - 1)] - dots[0];
+        }
+        subs.emplace_back(spawn(dim, dots[0], polyName, [=](MolangVariableMap& var) {
+            addXYZ(var, "variable.bsci_polyline_p1", offsets[0]);
+            addXYZ(var, "variable.bsci_polyline_p2", offsets[1]);
+            addXYZ(var, "variable.bsci_polyline_p3", offsets[2]);
+            var.setMolangVariable("variable.bsci_polyline_count", (float)count);
+            addThickness(var, width);
+            addTint(var, color);
+        }));
+    }
+    if (subs.empty()) return GeoId::invalid();
+    if (subs.size() == 1) {
+        place(subs.front(), dim, segments, width * 0.5f);
+        return subs.front();
+    }
+    // 与merge的结果相同，但子粒子没有单独登记过包围盒，不必逐个regroup
+    auto const id = GeometryGroup::getNextGeoId();
+    impl->geoGroup.try_emplace(id, std::move(subs));
+    place(id, dim, segments, width * 0.5f);
+    return id;
 }
 
 GeometryGroup::GeoId ParticleSpawner::point(
@@ -177,30 +870,225 @@ GeometryGroup::GeoId ParticleSpawner::point(
     mce::Color const&    color,
     std::optional<float> radius
 ) {
-    MolangVariableMap var;
-    addSize(
-        var,
-        {radius.value_or(
-            BedrockServerClientInterface::getInstance().getConfig().particle.defaultPointRadius
-        )}
+    Vec2 const size{radius.value_or(
+        BedrockServerClientInterface::getInstance().getConfig().particle.defaultPointRadius
+    )};
+    return particle(
+        dim,
+        pos,
+        boundsOf(pos, pos, size.x),
+        impl->effectName("point", color),
+        [=](MolangVariableMap& var) {
+            addSize(var, size);
+            addTint(var, color);
+        }
+    );
+}
+
+GeometryGroup::GeoId ParticleSpawner::box(
+    DimensionType        dim,
+    AABB const&          box,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    auto const extent = (box.max - box.min) * 0.5f;
+    auto const width  = thickness.value_or(
+        BedrockServerClientInterface::getInstance().getConfig().particle.defaultThickness
+    );
+    return particle(
+        dim,
+        (box.min + box.max) * 0.5f,
+        boundsOf(box.min, box.max, width * 0.5f),
+        Impl::compoundName("box", color),
+        [=](MolangVariableMap& var) {
+            addXYZ(var, "variable.bsci_box_extent", extent);
+            addThickness(var, width);
+            addTint(var, color);
+        }
     );
-    addTint(var, color);
-    return particle(dim, pos, color.a == 1 ? "bsci:point" : "bsci:blend_point", std::move(var));
+}
+
+GeometryGroup::GeoId ParticleSpawner::ring(
+    DimensionType        dim,
+    Vec3 const&          center,
+    Vec3 const&          normal,
+    float                radius,
+    Vec3 const&          axis,
+    size_t               segments,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    auto const [t, b] = branchlessONB(normal);
+    auto const step   = (float)(360.0 / (double)segments);
+    auto const width  = thickness.value_or(
+        BedrockServerClientInterface::getInstance().getConfig().particle.defaultThickness
+    );
+
+    std::vector<GeoId> ids;
+    ids.reserve((segments + maxRingSegments - 1) / maxRingSegments);
+    for (size_t first = 0; first < segments; first += maxRingSegments) {
+        auto const phase = (float)(step * (double)first);
+        auto const count = (float)std::min(maxRingSegments, segments - first);
+        ids.emplace_back(particle(
+            dim,
+            center,
+            boundsOf(center, center, radius + width * 0.5f),
+            Impl::compoundName("ring", color),
+            [=, t = t, b = b](MolangVariableMap& var) {
+                var.setMolangVariable("variable.bsci_ring_radius", radius);
+                var.setMolangVariable("variable.bsci_ring_step", step);
+                var.setMolangVariable("variable.bsci_ring_phase", phase);
+                var.setMolangVariable("variable.bsci_ring_count", count);
+                addXYZ(var, "variable.bsci_ring_t", t);
+                addXYZ(var, "variable.bsci_ring_b", b);
+                addXYZ(var, "variable.bsci_ring_axis", axis);
+                addThickness(var, width);
+                addTint(var, color);
+            }
+        ));
+    }
+    return ids.size() == 1 ? ids.front() : merge(ids);
+}
+
+GeometryGroup::GeoId ParticleSpawner::circle(
+    DimensionType        dim,
+    Vec3 const&          center,
+    Vec3 const&          normal,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    RecordScope scope;
+    auto const  segments = circleSegments(radius);
+    return remember(
+        scope,
+        ring(dim, center, normal, radius, Vec3::ZERO(), segments, color, thickness),
+        circleRecipe(dim, center, normal, radius, color, thickness)
+    );
+}
+
+GeometryGroup::GeoId ParticleSpawner::cylinder(
+    DimensionType        dim,
+    Vec3 const&          topCenter,
+    Vec3 const&          bottomCenter,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    RecordScope scope;
+    auto const  normal   = (topCenter - bottomCenter).normalize();
+    auto const  segments = circleSegments(radius);
+    // 顶面的环同时带出侧棱
+    auto ids = std::array{
+        ring(dim, topCenter, normal, radius, bottomCenter - topCenter, segments, color, thickness),
+        ring(dim, bottomCenter, normal, radius, Vec3::ZERO(), segments, color, thickness),
+    };
+    return remember(
+        scope,
+        merge(ids),
+        cylinderRecipe(dim, topCenter, bottomCenter, radius, color, thickness)
+    );
+}
+
+GeometryGroup::GeoId ParticleSpawner::text(
+    DimensionType        dim,
+    Vec3 const&          pos,
+    std::string          text,
+    mce::Color const&    color,
+    std::optional<float> scale
+) {
+    auto const layout = StrokeFont::layout(text);
+    if (layout->segments.empty()) return GeoId::invalid();
+
+    auto const size   = scale.value_or(1.0f) * textHeight;
+    // 排版坐标中文字的中心为(width / 2, 1 - height / 2)
+    auto const center = Vec2{layout->width * 0.5f, 1.0f - layout->height * 0.5f};
+    Vec3 const origin = pos - Vec3{center.x * size, center.y * size, 0};
+    auto const place  = [&](Vec2 const& p) { return origin + Vec3{p.x * size, p.y * size, 0}; };
+
+    std::vector<LineSeg> segments;
+    segments.reserve(layout->segments.size());
+    for (auto& seg : layout->segments) segments.emplace_back(place(seg.begin), place(seg.end));
+    return emitLines(dim, segments, color, size * 0.12f);
+}
+
+GeometryGroup::Stats ParticleSpawner::stats() const {
+    Stats res{impl->persistent ? "persistent particle" : "particle"};
+    for (auto& [dim, p] : impl->snapshot()) {
+        res.primitives     += p->packets.size();
+        res.chunkIndexSize += p->chunkParticles.size();
+    }
+    size_t grouped{};
+    impl->geoGroup.for_each([&](auto const& iter) {
+        ++res.geoIds;
+        grouped += iter.second.size();
+    });
+    // 未被合并的粒子自身也是一个GeoId
+    res.geoIds += res.primitives - std::min(grouped, res.primitives);
+    return res;
+}
+
+// 格式：重复{GeoId, 包}，以GeoId 0结尾；然后重复{GeoId, 数量, 子GeoId...}，以GeoId 0结尾
+bool ParticleSpawner::save(SnapshotWriter& writer) const {
+    for (auto& [dim, p] : impl->snapshot()) {
+        p->packets.for_each([&writer](auto const& iter) {
+            if (!iter.second) return;
+            writer.write(iter.first.value);
+            writer.write(*iter.second);
+        });
+    }
+    writer.write(GeoId::invalid().value);
+    impl->geoGroup.for_each([&writer](auto const& iter) {
+        writer.write(iter.first.value);
+        writer.write((uint32_t)iter.second.size());
+        for (auto& id : iter.second) writer.write(id.value);
+    });
+    writer.write(GeoId::invalid().value);
+    return true;
+}
+
+bool ParticleSpawner::load(SnapshotReader& reader) {
+    GeoId last{};
+    for (;;) {
+        GeoId id{};
+        if (!reader.read(id.value)) return false;
+        if (id.value == 0) break;
+        auto packet = std::make_unique<SpawnParticleEffectPacket>();
+        if (!reader.read(*packet)) return false;
+        // 快照中没有包围盒，恢复的粒子按其中心点索引
+        place(id, packet->mVanillaDimensionId, {*packet->mPos, *packet->mPos});
+        impl->put(id, std::move(packet));
+        last.value = std::max(last.value, id.value);
+    }
+    for (;;) {
+        GeoId    id{};
+        uint32_t count{};
+        if (!reader.read(id.value)) return false;
+        if (id.value == 0) break;
+        if (!reader.read(count)) return false;
+        std::vector<GeoId> ids(count);
+        for (auto& sid : ids) {
+            if (!reader.read(sid.value)) return false;
+        }
+        regroup(id, ids);
+        impl->geoGroup.try_emplace(id, std::move(ids));
+        last.value = std::max(last.value, id.value);
+    }
+    reserveGeoIds(last);
+    return true;
 }
 
 bool ParticleSpawner::remove(GeoId id) {
     if (id.value == 0) {
         return false;
     }
-    if (!impl->geoGroup.erase_if(id, [this](auto&& iter) {
-            for (auto& subId : iter.second) {
-                impl->geoPackets.erase(subId);
-            }
-            return true;
-        })) {
-        return impl->geoPackets.erase(id);
-    }
-    return true;
+    forget(id);
+    return impl->discard(id);
+}
+
+size_t ParticleSpawner::clear() {
+    GeometryGroup::clear();
+    return impl->clear();
 }
 
 GeometryGroup::GeoId ParticleSpawner::merge(std::span<GeoId> ids) {
@@ -210,33 +1098,79 @@ GeometryGroup::GeoId ParticleSpawner::merge(std::span<GeoId> ids) {
     auto               id = GeometryGroup::getNextGeoId();
     std::vector<GeoId> res;
     res.reserve(ids.size());
+    regroup(id, ids);
     for (auto const& sid : ids) {
-        if (!impl->geoGroup.erase_if(sid, [this, &res](auto&& iter) {
-                res.append_range(std::move(iter.second));
-                return true;
-            })) {
-            res.push_back(sid);
-        }
+        forget(sid);
+        if (impl->isHidden(sid)) impl->setVisible(sid, true);
+        res.append_range(impl->detach(sid));
     }
     impl->geoGroup.try_emplace(id, std::move(res));
     return id;
 }
 
+size_t ParticleSpawner::reload() {
+    auto res = GeometryGroup::reload();
+    impl->retime();
+    return res;
+}
+
+bool ParticleSpawner::replace(GeoId target, GeoId source) {
+    if (target.value == 0 || source.value == 0) return false;
+    // target原先隐藏时替换后仍然隐藏，source绘制时已发出的粒子只能等它自然消失
+    auto const hidden = impl->isHidden(target);
+    impl->discard(target);
+    impl->geoGroup.insert_or_assign(target, impl->detach(source));
+    if (hidden) impl->setVisible(target, false);
+    return true;
+}
+
+bool ParticleSpawner::patch(GeoId target, GeoId source) {
+    if (target.value == 0 || source.value == 0) return false;
+    if (!impl->geoGroup.contains(target) && !impl->dims.contains(target)) return false;
+    impl->patch(target, source);
+    return true;
+}
+
+bool ParticleSpawner::setMotion(GeoId id, Motion const& motion) {
+    if (id.value == 0) return false;
+    if (!motion.keyframes.empty() || !impl->canDrive(id)) {
+        impl->drive(id, Vec3::ZERO());
+        return GeometryGroup::setMotion(id, motion);
+    }
+    GeometryGroup::setMotion(id, {});
+    impl->drive(id, motion.velocity);
+    return true;
+}
+
 bool ParticleSpawner::shift(GeoId id, Vec3 const& v) {
-    if (!impl->geoGroup.modify_if(id, [this, &v](auto&& i) {
+    moved(id, v);
+    if (!impl->geoGroup.modify_if(id, [this, id, &v](auto&& i) {
             for (auto& subId : i.second) {
-                impl->geoPackets.modify_if(subId, [this, &v](auto&& iter) {
+                impl->modify(subId, [this, id, subId, &v](auto&& iter) {
+                    if (!iter.second) return;
+                    impl->unindex(subId, *iter.second);
                     *iter.second->mPos += v;
-                    if (iter.second) impl->sendParticleImmediately(*iter.second);
+                    impl->drifts.modify_if(subId, [&v](auto&& drift) { drift.second.origin += v; });
+                    impl->index(subId, *iter.second);
+                    impl->sendParticleImmediately(id, *iter.second);
                 });
             }
         })) {
-        return impl->geoPackets.modify_if(id, [this, &v](auto&& iter) {
+        return impl->modify(id, [this, id, &v](auto&& iter) {
+            if (!iter.second) return;
+            impl->unindex(id, *iter.second);
             *iter.second->mPos += v;
-            if (iter.second) impl->sendParticleImmediately(*iter.second);
+            impl->drifts.modify_if(id, [&v](auto&& drift) { drift.second.origin += v; });
+            impl->index(id, *iter.second);
+            impl->sendParticleImmediately(id, *iter.second);
         });
     }
     return true;
 }
 
+bool ParticleSpawner::setVisible(GeoId id, bool visible) {
+    if (id.value == 0) return false;
+    return impl->setVisible(id, visible);
+}
+
 } // namespace bsci
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "bsci/GeometryGroup.h"
+#include "bsci/network/ViewerSet.h"
 
+#include <functional>
 #include <memory>
 
 #include <mc/util/MolangVariableMap.h>
@@ -11,18 +13,49 @@ class ParticleSpawner : public GeometryGroup {
     struct Impl;
     std::shared_ptr<Impl> impl;
 
+    // fill写入粒子的变量，保留下来用于之后以新的速度重建粒子
+    using Fill = std::function<void(MolangVariableMap&)>;
+
     GeoId particle(
         DimensionType      dim,
         Vec3 const&        pos,
+        AABB const&        bounds,
         std::string const& name,
-        MolangVariableMap  var = {}
-    ) const;
+        Fill&&             fill
+    );
+
+    // 同particle，但不登记包围盒，由调用方成批生成后统一登记
+    GeoId spawn(DimensionType dim, Vec3 const& pos, std::string const& name, Fill&& fill);
+
+    GeoId ring(
+        DimensionType        dim,
+        Vec3 const&          center,
+        Vec3 const&          normal,
+        float                radius,
+        Vec3 const&          axis,
+        size_t               segments,
+        mce::Color const&    color,
+        std::optional<float> thickness
+    );
 
 public:
     BSCI_API ParticleSpawner();
 
+    // persistent: 使用长寿命粒子，只在变化、区块加载和保活时重发
+    // 已发出的粒子无法撤回，移动、移除或更新后旧的粒子会留到寿命结束，只适合静止的图形
+    BSCI_API explicit ParticleSpawner(bool persistent);
+
+    // viewers不为空时重发、补发都只发给其中的玩家，只在观看者所在的维度重发
+    BSCI_API ParticleSpawner(bool persistent, std::shared_ptr<ViewerSet> viewers);
+
     ~ParticleSpawner() override;
 
+    // 插件enable时注册、disable时移除每tick补发持久粒子的监听，移除时丢弃尚未补发的区块
+    // 区块发给客户端时只记下，之后每tick按particle.replayPacketsPerTick补发
+    static void startReplays();
+
+    static void stopReplays();
+
     GeoId point(
         DimensionType        dim,
         Vec3 const&          pos,
@@ -38,10 +71,74 @@ class ParticleSpawner : public GeometryGroup {
         std::optional<float> thickness = {}
     ) override;
 
+    // 只读一次配置、只生成一次特效名，所有线段粒子挂在同一个GeoId下
+    GeoId emitLines(
+        DimensionType            dim,
+        std::span<LineSeg const> segments,
+        mce::Color const&        color     = mce::Color::WHITE(),
+        std::optional<float>     thickness = {}
+    ) override;
+
+    GeoId
+    box(DimensionType        dim,
+        AABB const&          box,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}) override;
+
+    GeoId circle(
+        DimensionType        dim,
+        Vec3 const&          center,
+        Vec3 const&          normal,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId cylinder(
+        DimensionType        dim,
+        Vec3 const&          topCenter,
+        Vec3 const&          bottomCenter,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    // 以南向(+z)竖直平面上的笔画字体绘制，pos为整段文字的中心
+    GeoId text(
+        DimensionType        dim,
+        Vec3 const&          pos,
+        std::string          text,
+        mce::Color const&    color = mce::Color::WHITE(),
+        std::optional<float> scale = {}
+    ) override;
+
+    Stats stats() const override;
+
+    bool save(SnapshotWriter& writer) const override;
+
+    bool load(SnapshotReader& reader) override;
+
     bool remove(GeoId) override;
 
+    // 客户端上已生成的粒子无法主动移除，会在寿命结束后消失
+    size_t clear() override;
+
     GeoId merge(std::span<GeoId>) override;
 
     bool shift(GeoId, Vec3 const&) override;
+
+    // 隐藏的粒子不会立即消失，寿命结束前仍可见，持久模式下最长为keepAliveTime
+    bool setVisible(GeoId id, bool visible) override;
+
+    // 匀速运动由客户端的粒子自行移动，关键帧仍由服务端驱动
+    bool setMotion(GeoId id, Motion const& motion) override;
+
+    // 除重新细分外，还按新的tablePerTick、keepAliveTime重建已有粒子的寿命
+    size_t reload() override;
+
+protected:
+    bool replace(GeoId target, GeoId source) override;
+
+    bool patch(GeoId target, GeoId source) override;
 };
 } // namespace bsci
@@ -0,0 +1,481 @@
+#include "bsci/shared/SharedGeometryGroup.h"
+
+#include "bsci/utils/ShapeRecord.h"
+#include "bsci/utils/SpatialIndex.h"
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace bsci {
+
+class SharedGeometryGroup::Impl {
+public:
+    using Shape = shape::Record;
+
+    // 去重的键，按字节比较，浮点数不做取整
+    class Key {
+        std::string data;
+
+        void raw(void const* p, size_t size) { data.append(static_cast<char const*>(p), size); }
+
+    public:
+        explicit Key(size_t kind) { *this << (uint8_t)kind; }
+
+        template <class T>
+            requires std::is_arithmetic_v<T>
+        Key& operator<<(T v) {
+            raw(&v, sizeof(v));
+            return *this;
+        }
+        Key& operator<<(DimensionType dim) { return *this << (int)dim; }
+        Key& operator<<(Vec3 const& v) { return *this << v.x << v.y << v.z; }
+        Key& operator<<(AABB const& box) { return *this << box.min << box.max; }
+        Key& operator<<(mce::Color const& c) { return *this << c.r << c.g << c.b << c.a; }
+        Key& operator<<(std::optional<float> const& v) {
+            return v ? *this << true << *v : *this << false;
+        }
+        Key& operator<<(std::string_view s) {
+            *this << s.size();
+            raw(s.data(), s.size());
+            return *this;
+        }
+        Key& operator<<(std::vector<Vec3> const& dots) {
+            *this << dots.size();
+            for (auto& dot : dots) *this << dot;
+            return *this;
+        }
+        Key& operator<<(std::vector<LineSeg> const& segments) {
+            *this << segments.size();
+            for (auto& seg : segments) *this << seg.begin << seg.end;
+            return *this;
+        }
+
+        std::string take() { return std::move(data); }
+    };
+
+    static std::string keyOf(Shape const& shape) {
+        Key key{shape.index()};
+        std::visit(
+            [&key](auto const& s) {
+                using T = std::decay_t<decltype(s)>;
+                if constexpr (std::is_same_v<T, shape::Point>) {
+                    key << s.dim << s.pos << s.color << s.radius;
+                } else if constexpr (std::is_same_v<T, shape::Line>) {
+                    key << s.dim << s.begin << s.end << s.color << s.thickness;
+                } else if constexpr (std::is_same_v<T, shape::Polyline>) {
+                    key << s.dim << s.dots << s.color << s.thickness;
+                } else if constexpr (std::is_same_v<T, shape::Lines>) {
+                    key << s.dim << s.segments << s.color << s.thickness;
+                } else if constexpr (std::is_same_v<T, shape::Box>) {
+                    key << s.dim << s.box << s.color << s.thickness;
+                } else if constexpr (std::is_same_v<T, shape::Circle>) {
+                    key << s.dim << s.center << s.normal << s.radius << s.color << s.thickness;
+                } else if constexpr (std::is_same_v<T, shape::Cylinder>) {
+                    key << s.dim << s.topCenter << s.bottomCenter << s.radius << s.color
+                        << s.thickness;
+                } else if constexpr (std::is_same_v<T, shape::Sphere>) {
+                    key << s.dim << s.center << s.radius << s.color << s.thickness;
+                } else if constexpr (std::is_same_v<T, shape::Arrow>) {
+                    key << s.dim << s.begin << s.end << s.color << s.headLength << s.headRadius;
+                } else if constexpr (std::is_same_v<T, shape::Text>) {
+                    key << s.dim << s.pos << std::string_view{s.text} << s.color << s.scale;
+                } else {
+                    key << s.dim << s.topCenter << s.bottomCenter << s.topRadius
+                        << s.bottomRadius << s.color << s.thickness;
+                }
+            },
+            shape
+        );
+        return key.take();
+    }
+
+    // 平移后的图元，方向向量保持不变
+    static void translate(shape::Point& s, Vec3 const& v) { s.pos += v; }
+    static void translate(shape::Line& s, Vec3 const& v) {
+        s.begin += v;
+        s.end   += v;
+    }
+    static void translate(shape::Polyline& s, Vec3 const& v) {
+        for (auto& dot : s.dots) dot += v;
+    }
+    static void translate(shape::Lines& s, Vec3 const& v) {
+        for (auto& seg : s.segments) {
+            seg.begin += v;
+            seg.end   += v;
+        }
+    }
+    static void translate(shape::Box& s, Vec3 const& v) { s.box = {s.box.min + v, s.box.max + v}; }
+    static void translate(shape::Circle& s, Vec3 const& v) { s.center += v; }
+    static void translate(shape::Cylinder& s, Vec3 const& v) {
+        s.topCenter    += v;
+        s.bottomCenter += v;
+    }
+    static void translate(shape::Sphere& s, Vec3 const& v) { s.center += v; }
+    static void translate(shape::Arrow& s, Vec3 const& v) {
+        s.begin += v;
+        s.end   += v;
+    }
+    static void translate(shape::Text& s, Vec3 const& v) { s.pos += v; }
+    static void translate(shape::Cone& s, Vec3 const& v) {
+        s.topCenter    += v;
+        s.bottomCenter += v;
+    }
+
+    static AABB around(Vec3 const& pos, float r) {
+        return {pos - Vec3{r, r, r}, pos + Vec3{r, r, r}};
+    }
+
+    static AABB span(Vec3 const& a, Vec3 const& b) { return SpatialIndex::unite({a, a}, {b, b}); }
+
+    // 用于本组的空间索引，圆和圆台按球包围
+    static AABB boundsOf(shape::Point const& s) { return around(s.pos, s.radius.value_or(0)); }
+    static AABB boundsOf(shape::Line const& s) { return span(s.begin, s.end); }
+    static AABB boundsOf(shape::Polyline const& s) {
+        AABB res{s.dots.front(), s.dots.front()};
+        for (auto& dot : s.dots) res = SpatialIndex::unite(res, {dot, dot});
+        return res;
+    }
+    static AABB boundsOf(shape::Lines const& s) {
+        AABB res = span(s.segments.front().begin, s.segments.front().end);
+        for (auto& seg : s.segments) res = SpatialIndex::unite(res, span(seg.begin, seg.end));
+        return res;
+    }
+    static AABB boundsOf(shape::Box const& s) { return s.box; }
+    static AABB boundsOf(shape::Circle const& s) { return around(s.center, s.radius); }
+    static AABB boundsOf(shape::Cylinder const& s) {
+        return SpatialIndex::unite(around(s.topCenter, s.radius), around(s.bottomCenter, s.radius));
+    }
+    static AABB boundsOf(shape::Sphere const& s) { return around(s.center, s.radius); }
+    static AABB boundsOf(shape::Arrow const& s) { return span(s.begin, s.end); }
+    static AABB boundsOf(shape::Text const& s) { return {s.pos, s.pos}; }
+    static AABB boundsOf(shape::Cone const& s) {
+        return SpatialIndex::unite(
+            around(s.topCenter, s.topRadius),
+            around(s.bottomCenter, s.bottomRadius)
+        );
+    }
+
+    // 所有共享组共用，图元以entry编号引用
+    class Store {
+        struct Entry {
+            std::string key;
+            Shape       shape;
+            GeoId       inner;
+            size_t      refs;
+        };
+
+        std::mutex                              mutex;
+        std::unique_ptr<GeometryGroup>          inner;
+        std::unordered_map<std::string, uint64> index;
+        std::unordered_map<uint64, Entry>       entries;
+        uint64                                  nextEntry{};
+
+    public:
+        explicit Store(std::unique_ptr<GeometryGroup> inner) : inner(std::move(inner)) {}
+
+        // 已有相同的图元时只增加引用计数，否则交给后端绘制，失败时返回0
+        // 锁内只占好entry，绘制和移除都在锁外进行，后端发送时不阻塞其他组
+        uint64 acquire(Shape&& shape) {
+            auto   key = keyOf(shape);
+            uint64 entry{};
+            {
+                std::lock_guard l{mutex};
+                if (auto it = index.find(key); it != index.end()) {
+                    ++entries.at(it->second).refs;
+                    return it->second;
+                }
+                entry = ++nextEntry;
+                index.emplace(key, entry);
+                entries.emplace(entry, Entry{std::move(key), shape, GeoId::invalid(), 1});
+            }
+            auto            id = shape::draw(*inner, shape);
+            std::lock_guard l{mutex};
+            // 本次调用持有的引用还没交出去，绘制期间entry不会被移除
+            auto it = entries.find(entry);
+            if (id.value != 0) {
+                it->second.inner = id;
+                return entry;
+            }
+            // 绘制期间拿到同一entry的调用之后释放时找不到它，不受影响
+            index.erase(it->second.key);
+            entries.erase(it);
+            return 0;
+        }
+
+        // 返回是否因引用计数归零而移除
+        bool release(uint64 entry) {
+            GeoId id{};
+            {
+                std::lock_guard l{mutex};
+                auto            it = entries.find(entry);
+                if (it == entries.end() || --it->second.refs != 0) return false;
+                id = it->second.inner;
+                index.erase(it->second.key);
+                entries.erase(it);
+            }
+            inner->remove(id);
+            return true;
+        }
+
+        std::optional<Shape> shapeOf(uint64 entry) {
+            std::lock_guard l{mutex};
+            auto            it = entries.find(entry);
+            if (it == entries.end()) return std::nullopt;
+            return it->second.shape;
+        }
+    };
+
+    static std::shared_ptr<Store> sharedStore() {
+        static std::mutex           mutex;
+        static std::weak_ptr<Store> current;
+        std::lock_guard             l{mutex};
+        if (auto store = current.lock()) return store;
+        auto store = std::make_shared<Store>(GeometryGroup::createDefault());
+        current    = store;
+        return store;
+    }
+
+    std::shared_ptr<Store> store{sharedStore()};
+
+    std::mutex                                      mutex;
+    std::unordered_map<uint64, std::vector<uint64>> refs; // 本组的GeoId到entry编号
+
+    std::vector<uint64> take(GeoId id) {
+        std::lock_guard l{mutex};
+        auto            node = refs.extract(id.value);
+        return node ? std::move(node.mapped()) : std::vector<uint64>{};
+    }
+
+    void hold(GeoId id, std::vector<uint64>&& entries) {
+        std::lock_guard l{mutex};
+        refs.insert_or_assign(id.value, std::move(entries));
+    }
+
+    // 每次调用都分配新的GeoId，并按图元登记包围盒
+    GeoId add(SharedGeometryGroup& group, Shape&& shape) {
+        auto const dim    = std::visit([](auto const& s) { return s.dim; }, shape);
+        auto const bounds = std::visit([](auto const& s) { return boundsOf(s); }, shape);
+        auto const entry  = store->acquire(std::move(shape));
+        if (entry == 0) return GeoId::invalid();
+        auto id = group.getNextGeoId();
+        hold(id, {entry});
+        group.place(id, dim, bounds);
+        return id;
+    }
+
+    size_t release(std::vector<uint64> const& entries) {
+        size_t res{};
+        for (auto entry : entries) res += store->release(entry);
+        return res;
+    }
+};
+
+SharedGeometryGroup::SharedGeometryGroup() : impl(std::make_unique<Impl>()) {}
+
+SharedGeometryGroup::~SharedGeometryGroup() {
+    delist();
+    if (clearsOnDestroy()) clear();
+    // 未clear时引用随impl一起丢弃，图元留在后端
+}
+
+GeometryGroup::Stats SharedGeometryGroup::stats() const {
+    Stats           res{"shared"};
+    std::lock_guard l{impl->mutex};
+    res.geoIds = impl->refs.size();
+    for (auto& [id, entries] : impl->refs) res.primitives += entries.size();
+    return res;
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::point(
+    DimensionType        dim,
+    Vec3 const&          pos,
+    mce::Color const&    color,
+    std::optional<float> radius
+) {
+    return impl->add(*this, shape::Point{dim, pos, color, radius});
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::line(
+    DimensionType        dim,
+    Vec3 const&          begin,
+    Vec3 const&          end,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    if (begin == end) return GeoId::invalid();
+    return impl->add(*this, shape::Line{dim, begin, end, color, thickness});
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::line(
+    DimensionType        dim,
+    std::span<Vec3>      dots,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    if (dots.size() < 2) return GeoId::invalid();
+    return impl->add(*this, shape::Polyline{dim, {dots.begin(), dots.end()}, color, thickness});
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::box(
+    DimensionType        dim,
+    AABB const&          box,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->add(*this, shape::Box{dim, box, color, thickness});
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::circle(
+    DimensionType        dim,
+    Vec3 const&          center,
+    Vec3 const&          normal,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->add(*this, shape::Circle{dim, center, normal, radius, color, thickness});
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::cylinder(
+    DimensionType        dim,
+    Vec3 const&          topCenter,
+    Vec3 const&          bottomCenter,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->add(
+        *this,
+        shape::Cylinder{dim, topCenter, bottomCenter, radius, color, thickness}
+    );
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::sphere(
+    DimensionType        dim,
+    Vec3 const&          center,
+    float                radius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->add(*this, shape::Sphere{dim, center, radius, color, thickness});
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::arrow(
+    DimensionType        dim,
+    Vec3 const&          begin,
+    Vec3 const&          end,
+    mce::Color const&    color,
+    std::optional<float> mArrowHeadLength,
+    std::optional<float> mArrowHeadRadius
+) {
+    if (begin == end) return GeoId::invalid();
+    return impl->add(
+        *this,
+        shape::Arrow{dim, begin, end, color, mArrowHeadLength, mArrowHeadRadius}
+    );
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::text(
+    DimensionType        dim,
+    Vec3 const&          pos,
+    std::string          text,
+    mce::Color const&    color,
+    std::optional<float> scale
+) {
+    return impl->add(*this, shape::Text{dim, pos, std::move(text), color, scale});
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::cone(
+    DimensionType        dim,
+    Vec3 const&          topCenter,
+    Vec3 const&          bottomCenter,
+    float                topRadius,
+    float                bottomRadius,
+    mce::Color const&    color,
+    std::optional<float> thickness
+) {
+    return impl->add(
+        *this,
+        shape::Cone{dim, topCenter, bottomCenter, topRadius, bottomRadius, color, thickness}
+    );
+}
+
+bool SharedGeometryGroup::remove(GeoId id) {
+    if (id.value == 0) return false;
+    auto entries = impl->take(id);
+    if (entries.empty()) return false;
+    forget(id);
+    impl->release(entries);
+    return true;
+}
+
+size_t SharedGeometryGroup::clear() {
+    GeometryGroup::clear();
+    std::unordered_map<uint64, std::vector<uint64>> refs;
+    {
+        std::lock_guard l{impl->mutex};
+        refs.swap(impl->refs);
+    }
+    size_t res{};
+    for (auto& [id, entries] : refs) res += impl->release(entries);
+    return res;
+}
+
+GeometryGroup::GeoId SharedGeometryGroup::merge(std::span<GeoId> ids) {
+    if (ids.empty()) return GeoId::invalid();
+    std::vector<uint64> entries;
+    for (auto& id : ids) {
+        auto taken = impl->take(id);
+        entries.insert(entries.end(), taken.begin(), taken.end());
+    }
+    if (entries.empty()) return GeoId::invalid();
+    auto newId = getNextGeoId();
+    regroup(newId, ids);
+    for (auto& id : ids) forget(id);
+    impl->hold(newId, std::move(entries));
+    return newId;
+}
+
+bool SharedGeometryGroup::shift(GeoId id, Vec3 const& v) {
+    if (id.value == 0) return false;
+    auto entries = impl->take(id);
+    if (entries.empty()) return false;
+    // 先取得移动后的图元再释放原来的，两组互相移到对方位置时不会重发
+    std::vector<uint64> res;
+    res.reserve(entries.size());
+    for (auto entry : entries) {
+        auto shape = impl->store->shapeOf(entry);
+        if (!shape) continue;
+        std::visit([&v](auto& s) { Impl::translate(s, v); }, *shape);
+        if (auto moved = impl->store->acquire(std::move(*shape)); moved != 0) res.push_back(moved);
+    }
+    impl->release(entries);
+    impl->hold(id, std::move(res));
+    moved(id, v);
+    return true;
+}
+
+bool SharedGeometryGroup::update(GeoId id, std::function<GeoId(GeometryGroup&)> const& draw) {
+    if (id.value == 0) return false;
+    {
+        std::lock_guard l{impl->mutex};
+        if (!impl->refs.contains(id.value)) return false;
+    }
+    // 不进入StageScope，新图元在绘制时已由后端发送，原有的只是增加了引用
+    auto fresh = draw(*this);
+    if (fresh.value == 0) return false;
+    auto old = impl->take(id);
+    impl->hold(id, impl->take(fresh));
+    impl->release(old);
+    forget(id);
+    regroup(id, {&fresh, 1});
+    forget(fresh);
+    return true;
+}
+} // namespace bsci
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "bsci/GeometryGroup.h"
+
+#include <memory>
+
+namespace bsci {
+// 内容寻址的前端：图元按类型、维度、几何参数和颜色去重，所有共享组共用同一个后端，
+// 相同的图元只绘制、发送和保存一次，各组的GeoId只持有引用，引用计数归零时才真正移除
+// 后端在第一个共享组创建时按defaultGroup创建，最后一个共享组析构后释放
+// 不支持setVisible：同一图元可能同时被其他组引用，隐藏会连带影响它们，总是返回false
+class SharedGeometryGroup : public GeometryGroup {
+    class Impl;
+    std::unique_ptr<Impl> impl;
+
+public:
+    BSCI_API SharedGeometryGroup();
+
+    BSCI_API ~SharedGeometryGroup() override;
+
+    // primitives为本组持有的引用数
+    Stats stats() const override;
+
+    GeoId point(
+        DimensionType        dim,
+        Vec3 const&          pos,
+        mce::Color const&    color  = mce::Color::WHITE(),
+        std::optional<float> radius = {}
+    ) override;
+
+    GeoId line(
+        DimensionType        dim,
+        Vec3 const&          begin,
+        Vec3 const&          end,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId line(
+        DimensionType        dim,
+        std::span<Vec3>      dots,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId
+    box(DimensionType        dim,
+        AABB const&          box,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}) override;
+
+    GeoId circle(
+        DimensionType        dim,
+        Vec3 const&          center,
+        Vec3 const&          normal,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId cylinder(
+        DimensionType        dim,
+        Vec3 const&          topCenter,
+        Vec3 const&          bottomCenter,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId sphere(
+        DimensionType        dim,
+        Vec3 const&          center,
+        float                radius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    GeoId arrow(
+        DimensionType        dim,
+        Vec3 const&          begin,
+        Vec3 const&          end,
+        mce::Color const&    color            = mce::Color::WHITE(),
+        std::optional<float> mArrowHeadLength = {},
+        std::optional<float> mArrowHeadRadius = {}
+    ) override;
+
+    GeoId text(
+        DimensionType        dim,
+        Vec3 const&          pos,
+        std::string          text,
+        mce::Color const&    color = mce::Color::WHITE(),
+        std::optional<float> scale = {}
+    ) override;
+
+    GeoId cone(
+        DimensionType        dim,
+        Vec3 const&          topCenter,
+        Vec3 const&          bottomCenter,
+        float                topRadius,
+        float                bottomRadius,
+        mce::Color const&    color     = mce::Color::WHITE(),
+        std::optional<float> thickness = {}
+    ) override;
+
+    // 只释放本组的引用，其他组仍在使用的图元保留在客户端
+    bool remove(GeoId) override;
+
+    // 返回引用计数归零而真正移除的图元数量
+    size_t clear() override;
+
+    // 只合并引用，不改动后端
+    GeoId merge(std::span<GeoId>) override;
+
+    // 共享的图元不能原地移动，移动后按新的内容重新去重
+    bool shift(GeoId, Vec3 const&) override;
+
+    // 画出的图元与原有的相同时沿用原来的，不会重新发送
+    bool update(GeoId id, std::function<GeoId(GeometryGroup&)> const& draw) override;
+};
+} // namespace bsci
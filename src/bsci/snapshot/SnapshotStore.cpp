@@ -0,0 +1,151 @@
+#include "bsci/snapshot/SnapshotStore.h"
+#include "BedrockServerClientInterface.h"
+#include "bsci/debug_draw/DebugDrawingHandler.h"
+#include "bsci/particle/ParticleSpawner.h"
+#include "bsci/utils/MappedFile.h"
+#include "bsci/utils/Snapshot.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace bsci::snapshot {
+
+constexpr uint32_t magic   = 0x53435342; // "BSCS"
+constexpr uint32_t version = 1;
+
+static std::mutex                                                      mutex;
+static std::unordered_map<std::string, std::shared_ptr<GeometryGroup>> groups;
+
+static bool validName(std::string const& name) {
+    return !name.empty() && name != "." && name != ".."
+        && std::ranges::all_of(name, [](char c) {
+               return std::isalnum((unsigned char)c) || c == '_' || c == '-' || c == '.';
+           });
+}
+
+static std::filesystem::path directory() {
+    return BedrockServerClientInterface::getInstance().getSelf().getDataDir() / u8"snapshots";
+}
+
+static std::filesystem::path pathOf(std::string const& name) {
+    return directory() / (name + ".bin");
+}
+
+// 与各后端stats().backend一致
+static std::shared_ptr<GeometryGroup> create(std::string_view backend) {
+    if (backend == "debugDraw") return std::make_shared<DebugDrawingHandler>();
+    if (backend == "particle") return std::make_shared<ParticleSpawner>(false);
+    if (backend == "persistent particle") return std::make_shared<ParticleSpawner>(true);
+    return nullptr;
+}
+
+std::shared_ptr<GeometryGroup> get(std::string const& name) {
+    if (!validName(name)) return nullptr;
+    std::lock_guard l{mutex};
+    auto [iter, inserted] = groups.try_emplace(name);
+    if (inserted) iter->second = GeometryGroup::createDefault();
+    return iter->second;
+}
+
+bool drop(std::string const& name) {
+    if (!validName(name)) return false;
+    std::error_code ec;
+    std::filesystem::remove(pathOf(name), ec);
+    std::lock_guard l{mutex};
+    return groups.erase(name) > 0;
+}
+
+size_t saveAll() {
+    auto& logger = BedrockServerClientInterface::getInstance().getLogger();
+
+    std::unordered_map<std::string, std::shared_ptr<GeometryGroup>> saving;
+    {
+        std::lock_guard l{mutex};
+        saving.swap(groups);
+    }
+    if (saving.empty()) return 0;
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory(), ec);
+
+    size_t res{};
+    for (auto& [name, group] : saving) {
+        auto const     backend = group->stats().backend;
+        SnapshotWriter writer;
+        writer.write(magic);
+        writer.write(version);
+        writer.write(backend);
+        if (!group->save(writer)) {
+            logger.warn("Geometry group {} ({}) does not support snapshots", name, backend);
+            continue;
+        }
+        // 先写临时文件再替换，避免中途失败留下损坏的快照
+        auto path = pathOf(name);
+        auto temp = path;
+        temp     += u8".tmp";
+        {
+            std::ofstream out{temp, std::ios::binary | std::ios::trunc};
+            out.write(writer.data().data(), (std::streamsize)writer.data().size());
+            if (!out) {
+                logger.error("Failed to write snapshot of geometry group {}", name);
+                continue;
+            }
+        }
+        std::filesystem::rename(temp, path, ec);
+        if (ec) {
+            logger.error("Failed to write snapshot of geometry group {}: {}", name, ec.message());
+            continue;
+        }
+        ++res;
+    }
+    return res;
+}
+
+size_t restoreAll() {
+    auto& logger = BedrockServerClientInterface::getInstance().getLogger();
+
+    std::error_code ec;
+    size_t          res{};
+    for (auto& entry : std::filesystem::directory_iterator{directory(), ec}) {
+        if (entry.path().extension() != u8".bin") continue;
+        auto const  stem = entry.path().stem().u8string();
+        std::string name{stem.begin(), stem.end()};
+        if (!validName(name)) continue;
+
+        MappedFile file{entry.path()};
+        if (!file) {
+            logger.error("Failed to open snapshot of geometry group {}", name);
+            continue;
+        }
+        SnapshotReader reader{file.data()};
+        uint32_t       fileMagic{}, fileVersion{};
+        std::string    backend;
+        if (!reader.read(fileMagic) || fileMagic != magic || !reader.read(fileVersion)
+            || fileVersion != version || !reader.read(backend)) {
+            logger.warn("Ignored snapshot of geometry group {} with unknown format", name);
+            continue;
+        }
+        auto group = create(backend);
+        if (!group) {
+            logger.warn(
+                "Ignored snapshot of geometry group {} with unknown backend {}",
+                name,
+                backend
+            );
+            continue;
+        }
+        if (!group->load(reader) || !reader.ok()) {
+            logger.error("Snapshot of geometry group {} is corrupted", name);
+            continue;
+        }
+        std::lock_guard l{mutex};
+        groups.insert_or_assign(std::move(name), std::move(group));
+        ++res;
+    }
+    return res;
+}
+} // namespace bsci::snapshot
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "bsci/GeometryGroup.h"
+
+#include <memory>
+#include <string>
+
+namespace bsci::snapshot {
+// 名称只能包含字母、数字、'_'、'-'和'.'，否则返回nullptr
+std::shared_ptr<GeometryGroup> get(std::string const& name);
+
+bool drop(std::string const& name);
+
+// 模组关闭时调用，写入并释放所有持久图形组，返回成功写入的数量
+size_t saveAll();
+
+// 模组启用时调用，恢复上次写入的所有持久图形组，返回成功恢复的数量
+size_t restoreAll();
+} // namespace bsci::snapshot
@@ -0,0 +1,39 @@
+#include "bsci/utils/MappedFile.h"
+
+#include <Windows.h>
+
+namespace bsci {
+
+MappedFile::MappedFile(std::filesystem::path const& path) {
+    auto handle = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr
+    );
+    if (handle == INVALID_HANDLE_VALUE) return;
+    file = handle;
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(handle, &size)) return;
+    length = (size_t)size.QuadPart;
+    if (length == 0) { // 空文件无法创建映射
+        opened = true;
+        return;
+    }
+
+    mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return;
+    view   = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    opened = view != nullptr;
+}
+
+MappedFile::~MappedFile() {
+    if (view) UnmapViewOfFile(view);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+}
+} // namespace bsci
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+namespace bsci {
+// 只读内存映射文件，读取大文件时不需要先整体拷贝到内存
+class MappedFile {
+    void*       file{};
+    void*       mapping{};
+    void const* view{};
+    size_t      length{};
+    bool        opened{};
+
+public:
+    explicit MappedFile(std::filesystem::path const& path);
+
+    MappedFile(MappedFile const&)            = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    ~MappedFile();
+
+    explicit operator bool() const { return opened; }
+
+    std::string_view data() const { return {static_cast<char const*>(view), length}; }
+};
+} // namespace bsci
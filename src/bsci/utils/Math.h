@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <utility>
 
 #include <mc/deps/core/math/Vec2.h>
 #include <mc/deps/core/math/Vec3.h>
@@ -20,4 +22,34 @@ inline std::pair<Vec3, Vec3> branchlessONB(Vec3 const& n) {
     };
 }
 
+inline float dot(Vec3 const& a, Vec3 const& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+// 线段p1q1与p2q2上距离最近的两点，以各自线段上[0, 1]内的参数表示
+inline std::pair<float, float>
+closestOnSegments(Vec3 const& p1, Vec3 const& q1, Vec3 const& p2, Vec3 const& q2) {
+    constexpr float eps = 1e-8f;
+    auto const      d1  = q1 - p1;
+    auto const      d2  = q2 - p2;
+    auto const      r   = p1 - p2;
+    auto const      a   = dot(d1, d1);
+    auto const      e   = dot(d2, d2);
+    auto const      f   = dot(d2, r);
+    if (a <= eps && e <= eps) return {0.0f, 0.0f};
+    if (a <= eps) return {0.0f, std::clamp(f / e, 0.0f, 1.0f)};
+    auto const c = dot(d1, r);
+    if (e <= eps) return {std::clamp(-c / a, 0.0f, 1.0f), 0.0f};
+    auto const b     = dot(d1, d2);
+    auto const denom = a * e - b * b;
+    auto       s     = denom > eps ? std::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+    auto       t     = (b * s + f) / e;
+    if (t < 0) {
+        t = 0;
+        s = std::clamp(-c / a, 0.0f, 1.0f);
+    } else if (t > 1) {
+        t = 1;
+        s = std::clamp((b - c) / a, 0.0f, 1.0f);
+    }
+    return {s, t};
+}
+
 } // namespace bsci
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "bsci/utils/Metrics.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <ll/api/event/EventBus.h>
+#include <ll/api/event/Listener.h>
+#include <ll/api/event/world/ServerLevelTickEvent.h>
+
+namespace bsci::metrics {
+
+struct Block {
+    std::array<std::atomic_uint64_t, (size_t)Counter::Count> values{};
+};
+
+static std::mutex                          blocksMutex;
+static std::vector<std::shared_ptr<Block>> blocks; // 线程退出后保留，计数不丢失
+
+static Block& localBlock() {
+    thread_local std::shared_ptr<Block> block = [] {
+        auto            res = std::make_shared<Block>();
+        std::lock_guard l{blocksMutex};
+        blocks.push_back(res);
+        return res;
+    }();
+    return *block;
+}
+
+void add(Counter counter, uint64_t value) {
+    auto& v = localBlock().values[(size_t)counter];
+    v.store(v.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+uint64_t total(Counter counter) {
+    uint64_t        res{};
+    std::lock_guard l{blocksMutex};
+    for (auto& block : blocks) {
+        res += block->values[(size_t)counter].load(std::memory_order_relaxed);
+    }
+    return res;
+}
+
+constexpr size_t sampleTicks = 20;
+
+struct Sample {
+    uint64_t packets{};
+    uint64_t bytes{};
+    uint64_t resendTicks{};
+    uint64_t resendNanos{};
+    uint64_t chunkHookNanos{};
+};
+
+static std::mutex                          samplesMutex;
+static std::array<Sample, sampleTicks + 1> samples{};
+static size_t                              sampleCount{};
+static ll::event::ListenerPtr              listener;
+
+static void sample() {
+    Sample s{
+        total(Counter::PacketsSent),
+        total(Counter::BytesSent),
+        total(Counter::ResendTicks),
+        total(Counter::ResendTickNanos),
+        total(Counter::ChunkHookNanos),
+    };
+    std::lock_guard l{samplesMutex};
+    samples[sampleCount++ % samples.size()] = s;
+}
+
+TickRates rates() {
+    std::lock_guard l{samplesMutex};
+    if (sampleCount < 2) return {};
+    auto const  ticks  = std::min(sampleCount - 1, sampleTicks);
+    auto const& last   = samples[(sampleCount - 1) % samples.size()];
+    auto const& first  = samples[(sampleCount - 1 - ticks) % samples.size()];
+    auto const  resend = last.resendTicks - first.resendTicks;
+    return {
+        (double)(last.packets - first.packets) / (double)ticks,
+        (double)(last.bytes - first.bytes) / (double)ticks,
+        resend ? (double)(last.resendNanos - first.resendNanos) / 1000.0 / (double)resend : 0.0,
+        (double)(last.chunkHookNanos - first.chunkHookNanos) / 1000.0 / (double)ticks,
+    };
+}
+
+void startSampling() {
+    if (listener) return;
+    listener =
+        ll::event::EventBus::getInstance().emplaceListener<ll::event::world::ServerLevelTickEvent>(
+            [](ll::event::world::ServerLevelTickEvent&) { sample(); }
+        );
+}
+
+void stopSampling() {
+    if (!listener) return;
+    ll::event::EventBus::getInstance().removeListener<ll::event::world::ServerLevelTickEvent>(
+        listener
+    );
+    listener.reset();
+}
+
+} // namespace bsci::metrics
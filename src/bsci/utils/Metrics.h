@@ -0,0 +1,66 @@
+#pragma once
+
+#include "bsci/Marcos.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <ll/api/thread/ServerThreadExecutor.h>
+
+namespace bsci::metrics {
+enum class Counter : size_t {
+    PacketsSent,
+    BytesSent,
+    ChunkHookCalls,
+    ChunkHookNanos,
+    ResendTicks,
+    ResendTickNanos,
+    TasksQueued,
+    TasksDone,
+    Count,
+};
+
+// 每个线程写自己的计数块，读取时再汇总，热路径上不产生竞争
+BSCI_API void add(Counter counter, uint64_t value = 1);
+
+BSCI_API uint64_t total(Counter counter);
+
+struct TickRates {
+    double packetsPerTick{};
+    double bytesPerTick{};
+    double resendTickMicros{};
+    double chunkHookMicrosPerTick{};
+};
+
+// 最近20tick的平均值
+BSCI_API TickRates rates();
+
+void startSampling();
+
+void stopSampling();
+
+class ScopedTimer {
+    Counter                               counter;
+    std::chrono::steady_clock::time_point begin{std::chrono::steady_clock::now()};
+
+public:
+    explicit ScopedTimer(Counter counter) : counter(counter) {}
+    ~ScopedTimer() {
+        add(counter,
+            (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin
+            )
+                .count());
+    }
+};
+
+template <class F>
+void execute(F&& f) {
+    add(Counter::TasksQueued);
+    ll::thread::ServerThreadExecutor::getDefault().execute([f = std::forward<F>(f)]() mutable {
+        f();
+        add(Counter::TasksDone);
+    });
+}
+} // namespace bsci::metrics
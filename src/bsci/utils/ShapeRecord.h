@@ -0,0 +1,127 @@
+#pragma once
+
+#include "bsci/GeometryGroup.h"
+
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace bsci::shape {
+// 一次图元调用的全部参数，先记下来，之后再交给某个GeometryGroup绘制
+// CommandBufferGroup用它排队，SharedGeometryGroup用它去重
+using GeoId = GeometryGroup::GeoId;
+
+struct Point {
+    DimensionType        dim;
+    Vec3                 pos;
+    mce::Color           color;
+    std::optional<float> radius;
+
+    GeoId draw(GeometryGroup& g) { return g.point(dim, pos, color, radius); }
+};
+struct Line {
+    DimensionType        dim;
+    Vec3                 begin;
+    Vec3                 end;
+    mce::Color           color;
+    std::optional<float> thickness;
+
+    GeoId draw(GeometryGroup& g) { return g.line(dim, begin, end, color, thickness); }
+};
+struct Polyline {
+    DimensionType        dim;
+    std::vector<Vec3>    dots;
+    mce::Color           color;
+    std::optional<float> thickness;
+
+    GeoId draw(GeometryGroup& g) { return g.line(dim, dots, color, thickness); }
+};
+struct Lines {
+    DimensionType                       dim;
+    std::vector<GeometryGroup::LineSeg> segments;
+    mce::Color                          color;
+    std::optional<float>                thickness;
+
+    GeoId draw(GeometryGroup& g) { return g.emitLines(dim, segments, color, thickness); }
+};
+struct Box {
+    DimensionType        dim;
+    AABB                 box;
+    mce::Color           color;
+    std::optional<float> thickness;
+
+    GeoId draw(GeometryGroup& g) { return g.box(dim, box, color, thickness); }
+};
+struct Circle {
+    DimensionType        dim;
+    Vec3                 center;
+    Vec3                 normal;
+    float                radius;
+    mce::Color           color;
+    std::optional<float> thickness;
+
+    GeoId draw(GeometryGroup& g) { return g.circle(dim, center, normal, radius, color, thickness); }
+};
+struct Cylinder {
+    DimensionType        dim;
+    Vec3                 topCenter;
+    Vec3                 bottomCenter;
+    float                radius;
+    mce::Color           color;
+    std::optional<float> thickness;
+
+    GeoId draw(GeometryGroup& g) {
+        return g.cylinder(dim, topCenter, bottomCenter, radius, color, thickness);
+    }
+};
+struct Sphere {
+    DimensionType        dim;
+    Vec3                 center;
+    float                radius;
+    mce::Color           color;
+    std::optional<float> thickness;
+
+    GeoId draw(GeometryGroup& g) { return g.sphere(dim, center, radius, color, thickness); }
+};
+struct Arrow {
+    DimensionType        dim;
+    Vec3                 begin;
+    Vec3                 end;
+    mce::Color           color;
+    std::optional<float> headLength;
+    std::optional<float> headRadius;
+
+    GeoId draw(GeometryGroup& g) { return g.arrow(dim, begin, end, color, headLength, headRadius); }
+};
+struct Text {
+    DimensionType        dim;
+    Vec3                 pos;
+    std::string          text;
+    mce::Color           color;
+    std::optional<float> scale;
+
+    // 记录之后可能还要用到，文字按值复制
+    GeoId draw(GeometryGroup& g) { return g.text(dim, pos, text, color, scale); }
+};
+struct Cone {
+    DimensionType        dim;
+    Vec3                 topCenter;
+    Vec3                 bottomCenter;
+    float                topRadius;
+    float                bottomRadius;
+    mce::Color           color;
+    std::optional<float> thickness;
+
+    GeoId draw(GeometryGroup& g) {
+        return g.cone(dim, topCenter, bottomCenter, topRadius, bottomRadius, color, thickness);
+    }
+};
+
+using Record =
+    std::variant<Point, Line, Polyline, Lines, Box, Circle, Cylinder, Sphere, Arrow, Text, Cone>;
+
+inline GeoId draw(GeometryGroup& g, Record& record) {
+    return std::visit([&g](auto& s) { return s.draw(g); }, record);
+}
+} // namespace bsci::shape
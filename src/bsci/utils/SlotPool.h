@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace bsci {
+// 按块分配的对象池，用带代数的句柄代替shared_ptr/weak_ptr
+// 句柄对应的对象被释放后，get会返回nullptr
+// 本身不加锁，由使用者保证同步
+template <class T, size_t BlockSize = 1024>
+class SlotPool {
+public:
+    struct Handle {
+        uint32_t index{};
+        uint32_t generation{}; // 0表示无效句柄
+
+        constexpr bool operator==(Handle const&) const = default;
+        explicit constexpr operator bool() const { return generation != 0; }
+    };
+
+private:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    struct Slot {
+        std::optional<T> value;
+        uint32_t         generation{1};
+        uint32_t         nextFree{npos};
+    };
+    using Block = std::array<Slot, BlockSize>;
+
+    std::vector<std::unique_ptr<Block>> blocks;
+    uint32_t                            freeHead{npos};
+    uint32_t                            capacity{};
+    size_t                              count{};
+
+    Slot& slot(uint32_t index) { return (*blocks[index / BlockSize])[index % BlockSize]; }
+
+public:
+    template <class... Args>
+    Handle emplace(Args&&... args) {
+        if (freeHead == npos) {
+            blocks.emplace_back(std::make_unique<Block>());
+            for (uint32_t i = BlockSize; i > 0; i--) {
+                slot(capacity + i - 1).nextFree = freeHead;
+                freeHead                        = capacity + i - 1;
+            }
+            capacity += BlockSize;
+        }
+        auto  index = freeHead;
+        auto& s     = slot(index);
+        freeHead    = s.nextFree;
+        s.value.emplace(std::forward<Args>(args)...);
+        ++count;
+        return {index, s.generation};
+    }
+
+    bool erase(Handle handle) {
+        if (!get(handle)) return false;
+        auto& s = slot(handle.index);
+        s.value.reset();
+        if (++s.generation == 0) s.generation = 1;
+        s.nextFree = freeHead;
+        freeHead   = handle.index;
+        --count;
+        return true;
+    }
+
+    T* get(Handle handle) {
+        if (!handle || handle.index >= capacity) return nullptr;
+        auto& s = slot(handle.index);
+        return s.generation == handle.generation && s.value ? &*s.value : nullptr;
+    }
+
+    T const* get(Handle handle) const { return const_cast<SlotPool*>(this)->get(handle); }
+
+    size_t size() const { return count; }
+
+    template <class F>
+    void forEach(F&& f) {
+        for (uint32_t i = 0; i < capacity; i++) {
+            if (auto& s = slot(i); s.value) f(*s.value);
+        }
+    }
+
+    // 保留已分配的块，每个槽位的代数都加一，旧句柄不会指到之后放入的对象上
+    void clear() {
+        freeHead = npos;
+        for (uint32_t i = capacity; i > 0; i--) {
+            auto& s = slot(i - 1);
+            s.value.reset();
+            if (++s.generation == 0) s.generation = 1;
+            s.nextFree = freeHead;
+            freeHead   = i - 1;
+        }
+        count = 0;
+    }
+};
+
+// 只有一个元素时不分配堆内存的句柄列表
+template <class Handle>
+class HandleList {
+    Handle              single{};
+    std::vector<Handle> many;
+
+public:
+    HandleList() = default;
+    explicit HandleList(Handle handle) : single(handle) {}
+
+    void push_back(Handle handle) {
+        if (!single && many.empty()) {
+            single = handle;
+            return;
+        }
+        if (single) {
+            many.reserve(2);
+            many.push_back(single);
+            single = {};
+        }
+        many.push_back(handle);
+    }
+
+    void append(HandleList&& other) {
+        if (empty()) {
+            *this = std::move(other);
+            return;
+        }
+        for (auto h : other.span()) push_back(h);
+        other = {};
+    }
+
+    template <class F>
+    size_t erase_if(F&& f) {
+        if (single) {
+            if (!f(single)) return 0;
+            single = {};
+            return 1;
+        }
+        return std::erase_if(many, std::forward<F>(f));
+    }
+
+    std::span<Handle const> span() const {
+        return single ? std::span<Handle const>{&single, 1} : std::span<Handle const>{many};
+    }
+
+    bool   empty() const { return !single && many.empty(); }
+    size_t size() const { return single ? 1 : many.size(); }
+};
+} // namespace bsci
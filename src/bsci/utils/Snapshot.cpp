@@ -0,0 +1,36 @@
+#include "bsci/utils/Snapshot.h"
+
+#include <mc/deps/core/utility/BinaryStream.h>
+#include <mc/deps/core/utility/ReadOnlyBinaryStream.h>
+#include <mc/network/Packet.h>
+
+namespace bsci {
+
+void SnapshotWriter::write(std::string_view str) {
+    write((uint32_t)str.size());
+    buffer.append(str);
+}
+
+void SnapshotWriter::write(Packet const& packet) {
+    BinaryStream stream;
+    packet.write(stream);
+    write(std::string_view{stream.getAndReleaseData()});
+}
+
+bool SnapshotReader::read(std::string& str) {
+    uint32_t size{};
+    if (!read(size) || data.size() < size) return fail();
+    str.assign(data.substr(0, size));
+    data.remove_prefix(size);
+    return true;
+}
+
+bool SnapshotReader::read(Packet& packet) {
+    uint32_t size{};
+    if (!read(size) || data.size() < size) return fail();
+    ReadOnlyBinaryStream stream{data.substr(0, size), false};
+    data.remove_prefix(size);
+    if (!packet.read(stream)) return fail();
+    return true;
+}
+} // namespace bsci
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "bsci/Marcos.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+class Packet;
+
+namespace bsci {
+// 快照使用的紧凑二进制格式，数值按本机字节序直接写入
+class SnapshotWriter {
+    std::string buffer;
+
+public:
+    template <class T>
+        requires std::is_trivially_copyable_v<T>
+    void write(T const& value) {
+        buffer.append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    BSCI_API void write(std::string_view str);
+
+    // 用游戏自身的序列化写入包，读回时无需重新细分图形
+    BSCI_API void write(Packet const& packet);
+
+    std::string const& data() const { return buffer; }
+};
+
+// 直接在映射的文件内存上读取，任何越界都会使后续读取全部失败
+class SnapshotReader {
+    std::string_view data;
+    bool             failed{};
+
+public:
+    explicit SnapshotReader(std::string_view data) : data(data) {}
+
+    template <class T>
+        requires std::is_trivially_copyable_v<T>
+    bool read(T& value) {
+        if (failed || data.size() < sizeof(T)) return fail();
+        std::memcpy(&value, data.data(), sizeof(T));
+        data.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    BSCI_API bool read(std::string& str);
+
+    BSCI_API bool read(Packet& packet);
+
+    bool fail() {
+        failed = true;
+        return false;
+    }
+
+    bool ok() const { return !failed; }
+
+    bool empty() const { return data.empty(); }
+};
+} // namespace bsci
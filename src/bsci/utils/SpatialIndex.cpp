@@ -0,0 +1,272 @@
+#include "bsci/utils/SpatialIndex.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <queue>
+#include <tuple>
+
+namespace bsci {
+
+// 表面积的一半，作为插入代价
+static float perimeter(AABB const& box) {
+    auto const d = box.max - box.min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// 射线进入box时走过的距离，超过maxDist或不相交时返回空
+static std::optional<float>
+entryDistance(AABB const& box, Vec3 const& origin, Vec3 const& dir, float maxDist) {
+    float      enter{}, exit{maxDist};
+    auto const slab = [&](float o, float d, float lo, float hi) {
+        if (std::abs(d) < 1e-8f) return o >= lo && o <= hi; // 与该轴平行
+        float t0 = (lo - o) / d;
+        float t1 = (hi - o) / d;
+        if (t0 > t1) std::swap(t0, t1);
+        enter = std::max(enter, t0);
+        exit  = std::min(exit, t1);
+        return enter <= exit;
+    };
+    if (!slab(origin.x, dir.x, box.min.x, box.max.x) || !slab(origin.y, dir.y, box.min.y, box.max.y)
+        || !slab(origin.z, dir.z, box.min.z, box.max.z)) {
+        return std::nullopt;
+    }
+    return enter;
+}
+
+static float distanceSqr(AABB const& box, Vec3 const& pos) {
+    auto const axis = [](float p, float lo, float hi) {
+        auto const d = std::max({lo - p, 0.0f, p - hi});
+        return d * d;
+    };
+    return axis(pos.x, box.min.x, box.max.x) + axis(pos.y, box.min.y, box.max.y)
+         + axis(pos.z, box.min.z, box.max.z);
+}
+
+std::optional<SpatialIndex::Hit> SpatialIndex::raycast(
+    Vec3 const&   origin,
+    Vec3 const&   dir,
+    float         maxDist,
+    Narrow const& narrow
+) const {
+    std::optional<Hit> res;
+    if (root == null) return res;
+    auto const rootEntry = entryDistance(nodes[root].box, origin, dir, maxDist);
+    if (!rootEntry) return res;
+    // 先展开较近的子节点，只深入进入距离比当前结果更近的子树
+    std::vector<std::pair<float, Proxy>> stack{{*rootEntry, root}};
+    while (!stack.empty()) {
+        auto const [t, p] = stack.back();
+        stack.pop_back();
+        if (res && t >= res->distance) continue;
+        auto& node = nodes[p];
+        if (node.left == null) {
+            std::optional<float> d = t;
+            if (narrow) d = narrow(node.value, t);
+            if (d && (!res || *d < res->distance)) res = Hit{node.value, *d};
+            continue;
+        }
+        auto const limit = res ? res->distance : maxDist;
+        auto const left  = entryDistance(nodes[node.left].box, origin, dir, limit);
+        auto const right = entryDistance(nodes[node.right].box, origin, dir, limit);
+        if (left && right && *left < *right) {
+            stack.emplace_back(*right, node.right);
+            stack.emplace_back(*left, node.left);
+        } else {
+            if (left) stack.emplace_back(*left, node.left);
+            if (right) stack.emplace_back(*right, node.right);
+        }
+    }
+    return res;
+}
+
+std::optional<SpatialIndex::Hit>
+SpatialIndex::nearest(Vec3 const& pos, float radius, Narrow const& narrow) const {
+    std::optional<Hit> res;
+    if (root == null) return res;
+    // 按到包围盒的距离由近到远展开；叶子经细检测后带着实际距离放回，
+    // 实际距离不小于包围盒距离，所以第一个取出的已检测叶子即为结果
+    using Item = std::tuple<float, Proxy, bool>;
+    std::priority_queue<Item, std::vector<Item>, std::greater<>> queue;
+    queue.emplace(distanceSqr(nodes[root].box, pos), root, false);
+    auto const limit = radius * radius;
+    while (!queue.empty()) {
+        auto [d, p, exact] = queue.top();
+        queue.pop();
+        if (d > limit) break;
+        if (exact) return Hit{nodes[p].value, std::sqrt(d)};
+        if (isLeaf(p)) {
+            std::optional<float> e = std::sqrt(d);
+            if (narrow) e = narrow(nodes[p].value, *e);
+            if (e) queue.emplace(*e * *e, p, true);
+            continue;
+        }
+        for (auto child : std::array{nodes[p].left, nodes[p].right}) {
+            queue.emplace(distanceSqr(nodes[child].box, pos), child, false);
+        }
+    }
+    return res;
+}
+
+SpatialIndex::Proxy SpatialIndex::allocate() {
+    if (freeList == null) {
+        nodes.emplace_back();
+        return (Proxy)nodes.size() - 1;
+    }
+    auto p   = freeList;
+    freeList = nodes[p].next;
+    nodes[p] = Node{};
+    return p;
+}
+
+void SpatialIndex::release(Proxy p) {
+    nodes[p].next   = freeList;
+    nodes[p].height = -1;
+    freeList        = p;
+}
+
+SpatialIndex::Proxy SpatialIndex::insert(AABB const& box, uint64_t value) {
+    auto p         = allocate();
+    nodes[p].box   = box;
+    nodes[p].value = value;
+    insertLeaf(p);
+    ++count;
+    return p;
+}
+
+void SpatialIndex::remove(Proxy proxy) {
+    removeLeaf(proxy);
+    release(proxy);
+    --count;
+}
+
+void SpatialIndex::update(Proxy proxy, AABB const& box) {
+    removeLeaf(proxy);
+    nodes[proxy].box = box;
+    insertLeaf(proxy);
+}
+
+void SpatialIndex::clear() {
+    nodes.clear();
+    root     = null;
+    freeList = null;
+    count    = 0;
+}
+
+void SpatialIndex::insertLeaf(Proxy leaf) {
+    if (root == null) {
+        root               = leaf;
+        nodes[root].parent = null;
+        return;
+    }
+
+    // 自顶向下选择使总表面积增加最少的兄弟节点
+    auto const box   = nodes[leaf].box;
+    auto       index = root;
+    while (!isLeaf(index)) {
+        auto const left     = nodes[index].left;
+        auto const right    = nodes[index].right;
+        auto const area     = perimeter(nodes[index].box);
+        auto const combined = perimeter(unite(nodes[index].box, box));
+
+        auto const cost        = 2 * combined;
+        auto const inheritance = 2 * (combined - area);
+        auto const descend     = [&](Proxy child) {
+            auto const merged = perimeter(unite(box, nodes[child].box));
+            return (isLeaf(child) ? merged : merged - perimeter(nodes[child].box)) + inheritance;
+        };
+        auto const costLeft  = descend(left);
+        auto const costRight = descend(right);
+        if (cost < costLeft && cost < costRight) break;
+        index = costLeft < costRight ? left : right;
+    }
+
+    auto const sibling   = index;
+    auto const oldParent = nodes[sibling].parent;
+    auto const newParent = allocate();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box    = unite(box, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    if (oldParent != null) {
+        (nodes[oldParent].left == sibling ? nodes[oldParent].left : nodes[oldParent].right) =
+            newParent;
+    } else {
+        root = newParent;
+    }
+    nodes[newParent].left  = sibling;
+    nodes[newParent].right = leaf;
+    nodes[sibling].parent  = newParent;
+    nodes[leaf].parent     = newParent;
+    refit(newParent);
+}
+
+void SpatialIndex::removeLeaf(Proxy leaf) {
+    if (leaf == root) {
+        root = null;
+        return;
+    }
+    auto const parent  = nodes[leaf].parent;
+    auto const grand   = nodes[parent].parent;
+    auto const sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+    nodes[sibling].parent = grand;
+    if (grand != null) {
+        (nodes[grand].left == parent ? nodes[grand].left : nodes[grand].right) = sibling;
+        release(parent);
+        refit(grand);
+    } else {
+        root = sibling;
+        release(parent);
+    }
+}
+
+// 从p向上重新计算高度和包围盒，沿途做平衡
+void SpatialIndex::refit(Proxy p) {
+    while (p != null) {
+        p                = balance(p);
+        auto const left  = nodes[p].left;
+        auto const right = nodes[p].right;
+        nodes[p].height  = 1 + std::max(nodes[left].height, nodes[right].height);
+        nodes[p].box     = unite(nodes[left].box, nodes[right].box);
+        p                = nodes[p].parent;
+    }
+}
+
+// 左右子树高度差超过1时把较高的子节点旋转上来，返回旋转后位于原位置的节点
+SpatialIndex::Proxy SpatialIndex::balance(Proxy a) {
+    if (isLeaf(a) || nodes[a].height < 2) return a;
+
+    auto const rotate = [&](Proxy up, Proxy keep, bool upIsRight) {
+        auto const f = nodes[up].left;
+        auto const g = nodes[up].right;
+
+        nodes[up].left   = a;
+        nodes[up].parent = nodes[a].parent;
+        nodes[a].parent  = up;
+        if (auto parent = nodes[up].parent; parent != null) {
+            (nodes[parent].left == a ? nodes[parent].left : nodes[parent].right) = up;
+        } else {
+            root = up;
+        }
+
+        // 较高的孙节点留在up下，较矮的交给a
+        auto const taller  = nodes[f].height > nodes[g].height ? f : g;
+        auto const shorter = taller == f ? g : f;
+        nodes[up].right    = taller;
+        (upIsRight ? nodes[a].right : nodes[a].left) = shorter;
+        nodes[shorter].parent                        = a;
+
+        nodes[a].box     = unite(nodes[keep].box, nodes[shorter].box);
+        nodes[up].box    = unite(nodes[a].box, nodes[taller].box);
+        nodes[a].height  = 1 + std::max(nodes[keep].height, nodes[shorter].height);
+        nodes[up].height = 1 + std::max(nodes[a].height, nodes[taller].height);
+        return up;
+    };
+
+    auto const b    = nodes[a].left;
+    auto const c    = nodes[a].right;
+    auto const diff = nodes[c].height - nodes[b].height;
+    if (diff > 1) return rotate(c, b, true);
+    if (diff < -1) return rotate(b, c, false);
+    return a;
+}
+} // namespace bsci
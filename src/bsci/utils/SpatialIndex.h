@@ -0,0 +1,108 @@
+#pragma once
+
+#include "bsci/Marcos.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <mc/world/phys/AABB.h>
+
+namespace bsci {
+// 动态AABB树，叶子保存包围盒和一个值，内部节点的包围盒为子树的并集
+// 插入时按表面积增量选择位置，并通过旋转保持平衡，查询只访问与区域相交的子树
+// 本身不加锁，由使用者保证同步
+class SpatialIndex {
+public:
+    using Proxy                 = int32_t;
+    static constexpr Proxy null = -1;
+
+    struct Hit {
+        uint64_t value;
+        float    distance;
+    };
+
+private:
+    struct Node {
+        AABB     box;
+        uint64_t value{};
+        Proxy    parent{null};
+        Proxy    left{null};  // 叶子为null
+        Proxy    right{null};
+        int32_t  height{};    // 叶子为0，空闲节点为-1
+        Proxy    next{null};  // 空闲链表
+    };
+
+    std::vector<Node> nodes;
+    Proxy             root{null};
+    Proxy             freeList{null};
+    size_t            count{};
+
+    bool isLeaf(Proxy p) const { return nodes[p].left == null; }
+
+    Proxy allocate();
+    void  release(Proxy p);
+    void  insertLeaf(Proxy leaf);
+    void  removeLeaf(Proxy leaf);
+    void  refit(Proxy p);
+    Proxy balance(Proxy a);
+
+    static bool intersects(AABB const& a, AABB const& b) {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y
+            && a.max.y >= b.min.y && a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+
+public:
+    static AABB unite(AABB const& a, AABB const& b) {
+        return {
+            Vec3{std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)},
+            Vec3{std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)}
+        };
+    }
+
+    BSCI_API Proxy insert(AABB const& box, uint64_t value);
+
+    BSCI_API void remove(Proxy proxy);
+
+    BSCI_API void update(Proxy proxy, AABB const& box);
+
+    AABB const& bounds(Proxy proxy) const { return nodes[proxy].box; }
+
+    size_t size() const { return count; }
+
+    BSCI_API void clear();
+
+    // 对每个与box相交的叶子调用f(value, bounds)
+    template <class F>
+    void query(AABB const& box, F&& f) const {
+        if (root == null) return;
+        std::vector<Proxy> stack{root};
+        while (!stack.empty()) {
+            auto& node = nodes[stack.back()];
+            stack.pop_back();
+            if (!intersects(node.box, box)) continue;
+            if (node.left == null) {
+                f(node.value, node.box);
+            } else {
+                stack.push_back(node.left);
+                stack.push_back(node.right);
+            }
+        }
+    }
+
+    // 细检测：给出叶子中实际图形的距离，不得小于到包围盒的距离；返回空表示未命中
+    using Narrow = std::function<std::optional<float>(uint64_t value, float boxDistance)>;
+
+    // 射线最先进入的包围盒，起点在包围盒内时距离为0；dir须为单位向量
+    // 给出narrow时包围盒只用于剪枝，结果按narrow的距离排序
+    BSCI_API std::optional<Hit>
+    raycast(Vec3 const& origin, Vec3 const& dir, float maxDist, Narrow const& narrow = {}) const;
+
+    // 与pos距离不超过radius的包围盒中最近的一个，pos在包围盒内时距离为0，narrow同raycast
+    BSCI_API std::optional<Hit>
+    nearest(Vec3 const& pos, float radius, Narrow const& narrow = {}) const;
+};
+} // namespace bsci
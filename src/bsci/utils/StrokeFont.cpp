@@ -0,0 +1,254 @@
+#include "bsci/utils/StrokeFont.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+namespace bsci {
+
+// 4x6网格上的笔画，每个点两位数字"xy"，点之间以空格分隔，笔画之间以'|'分隔
+// 下标为ASCII码减32，小写字母处留空，sourceOf取对应大写字母的字形
+static constexpr std::string_view glyphSource[]{
+    "",                                           // ' '
+    "26 22|21 20",                                // !
+    "16 14|36 34",                                // "
+    "16 10|36 30|04 44|02 42",                    // #
+    "45 36 16 05 04 13 33 42 41 30 10 01|26 20",  // $
+    "06 05 15 16 06|46 00|30 31 41 40 30",        // %
+    "40 04 05 16 26 35 34 01 10 20 42",           // &
+    "26 24",                                      // '
+    "36 25 21 30",                                // (
+    "16 25 21 10",                                // )
+    "12 34|14 32|03 43",                          // *
+    "21 25|03 43",                                // +
+    "21 10",                                      // ,
+    "03 43",                                      // -
+    "20 21",                                      // .
+    "00 46",                                      // /
+    "10 30 41 45 36 16 05 01 10|05 41",           // 0
+    "15 26 20|10 30",                             // 1
+    "05 16 36 45 44 00 40",                       // 2
+    "05 16 36 45 44 33 13|33 42 41 30 10 01",     // 3
+    "30 36 02 42",                                // 4
+    "46 06 04 34 43 41 30 10 01",                 // 5
+    "45 36 16 05 01 10 30 41 42 33 03",           // 6
+    "06 46 20",                                   // 7
+    "13 04 05 16 36 45 44 33 13 02 01 10 30 41 42 33", // 8
+    "01 10 30 41 45 36 16 05 04 13 43",           // 9
+    "25 24|22 21",                                // :
+    "25 24|22 10",                                // ;
+    "45 03 41",                                   // <
+    "02 42|04 44",                                // =
+    "05 43 01",                                   // >
+    "05 16 36 45 44 23 22|21 20",                 // ?
+    "32 12 14 34 31 41 45 36 16 05 01 10 40",     // @
+    "00 04 26 44 40|03 43",                       // A
+    "00 06 36 45 44 33 03|33 42 41 30 00",        // B
+    "45 36 16 05 01 10 30 41",                    // C
+    "00 06 36 45 41 30 00",                       // D
+    "40 00 06 46|03 33",                          // E
+    "00 06 46|03 33",                             // F
+    "45 36 16 05 01 10 30 41 43 23",              // G
+    "00 06|40 46|03 43",                          // H
+    "10 30|16 36|20 26",                          // I
+    "46 41 30 10 01 02",                          // J
+    "00 06|46 02|13 40",                          // K
+    "06 00 40",                                   // L
+    "00 06 23 46 40",                             // M
+    "00 06 40 46",                                // N
+    "10 30 41 45 36 16 05 01 10",                 // O
+    "00 06 36 45 44 33 03",                       // P
+    "10 30 41 45 36 16 05 01 10|22 40",           // Q
+    "00 06 36 45 44 33 03|23 40",                 // R
+    "45 36 16 05 04 13 33 42 41 30 10 01",        // S
+    "06 46|26 20",                                // T
+    "06 01 10 30 41 46",                          // U
+    "06 20 46",                                   // V
+    "06 10 23 30 46",                             // W
+    "00 46|06 40",                                // X
+    "06 23 46|23 20",                             // Y
+    "06 46 00 40",                                // Z
+    "36 26 20 30",                                // [
+    "06 40",                                      // '\'
+    "16 26 20 10",                                // ]
+    "14 26 34",                                   // ^
+    "00 40",                                      // _
+    "16 25",                                      // `
+    "",                                           // a
+    "",                                           // b
+    "",                                           // c
+    "",                                           // d
+    "",                                           // e
+    "",                                           // f
+    "",                                           // g
+    "",                                           // h
+    "",                                           // i
+    "",                                           // j
+    "",                                           // k
+    "",                                           // l
+    "",                                           // m
+    "",                                           // n
+    "",                                           // o
+    "",                                           // p
+    "",                                           // q
+    "",                                           // r
+    "",                                           // s
+    "",                                           // t
+    "",                                           // u
+    "",                                           // v
+    "",                                           // w
+    "",                                           // x
+    "",                                           // y
+    "",                                           // z
+    "36 25 24 13 22 21 30",                       // {
+    "26 20",                                      // |
+    "16 25 24 33 22 21 10",                       // }
+    "04 15 34 45",                                // ~
+};
+static_assert(std::size(glyphSource) == 127 - 32);
+
+constexpr float glyphWidth = 4.0f / 6.0f;
+
+// 小写字母没有单独的字形，使用压低的大写字母
+constexpr float lowercaseScale = 0.7f;
+
+static std::string_view sourceOf(char32_t c) {
+    if (c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+    if (c < 32 || c > 126) return "00 06 46 40 00"; // 方框
+    return glyphSource[c - 32];
+}
+
+static std::vector<StrokeFont::Segment> parse(std::string_view source, float scaleY) {
+    std::vector<StrokeFont::Segment> res;
+    std::optional<Vec2>              last;
+    for (size_t i = 0; i < source.size(); i++) {
+        auto ch = source[i];
+        if (ch == '|') {
+            last.reset();
+        } else if (ch >= '0' && ch <= '9' && i + 1 < source.size()) {
+            Vec2 pos{(float)(ch - '0') / 6.0f, (float)(source[++i] - '0') / 6.0f * scaleY};
+            if (last) res.emplace_back(*last, pos);
+            last = pos;
+        }
+    }
+    return res;
+}
+
+std::span<StrokeFont::Segment const> StrokeFont::glyph(char32_t c) {
+    // 全部ASCII字形一次解析完，之后只读
+    static auto const glyphs = [] {
+        std::array<std::vector<Segment>, 128> res;
+        for (char32_t i = 0; i < res.size(); i++) {
+            res[i] = parse(sourceOf(i), i >= 'a' && i <= 'z' ? lowercaseScale : 1.0f);
+        }
+        return res;
+    }();
+    static auto const unknown = parse(sourceOf(0), 1.0f);
+    return c < glyphs.size() ? glyphs[c] : unknown;
+}
+
+// 把同一直线上重叠或相接的线段合并，减少需要绘制的线段数
+static std::vector<StrokeFont::Segment> mergeCollinear(std::vector<StrokeFont::Segment> const& in
+) {
+    constexpr float precision = 1e4f;
+    auto            quantize  = [](float v) { return (long long)std::lround(v * precision); };
+
+    struct Line {
+        Vec2                                 dir;
+        float                                offset;
+        std::vector<std::pair<float, float>> spans;
+    };
+    std::map<std::tuple<long long, long long, long long>, Line> lines;
+    for (auto& seg : in) {
+        auto  d   = seg.end - seg.begin;
+        float len = std::sqrt(d.x * d.x + d.y * d.y);
+        if (len < 1 / precision) continue;
+        Vec2 dir{d.x / len, d.y / len};
+        if (dir.x < 0 || (dir.x == 0 && dir.y < 0)) dir = {-dir.x, -dir.y};
+        Vec2 const  normal{-dir.y, dir.x};
+        float const offset = normal.x * seg.begin.x + normal.y * seg.begin.y;
+        float       a      = dir.x * seg.begin.x + dir.y * seg.begin.y;
+        float       b      = dir.x * seg.end.x + dir.y * seg.end.y;
+        if (a > b) std::swap(a, b);
+
+        auto& line = lines[{quantize(dir.x), quantize(dir.y), quantize(offset)}];
+        line.dir    = dir;
+        line.offset = offset;
+        line.spans.emplace_back(a, b);
+    }
+
+    std::vector<StrokeFont::Segment> res;
+    for (auto& [key, line] : lines) {
+        std::sort(line.spans.begin(), line.spans.end());
+        Vec2 const normal{-line.dir.y, line.dir.x};
+        auto       at = [&](float t) {
+            return Vec2{
+                normal.x * line.offset + line.dir.x * t,
+                normal.y * line.offset + line.dir.y * t
+            };
+        };
+        auto current = line.spans.front();
+        for (size_t i = 1; i <= line.spans.size(); i++) {
+            if (i < line.spans.size() && line.spans[i].first <= current.second + 1 / precision) {
+                current.second = std::max(current.second, line.spans[i].second);
+                continue;
+            }
+            res.emplace_back(at(current.first), at(current.second));
+            if (i < line.spans.size()) current = line.spans[i];
+        }
+    }
+    return res;
+}
+
+// 按UTF-8解码，非ASCII字符整体算作一个未知字符
+static std::shared_ptr<StrokeFont::Layout const> build(std::string_view text) {
+    auto                             res = std::make_shared<StrokeFont::Layout>();
+    std::vector<StrokeFont::Segment> segments;
+    float                            x{}, y{};
+    for (size_t i = 0; i < text.size(); i++) {
+        auto byte = (unsigned char)text[i];
+        if ((byte & 0xC0) == 0x80) continue;
+        if (byte == '\n') {
+            x  = 0;
+            y -= StrokeFont::lineHeight;
+            continue;
+        }
+        char32_t c = byte < 0x80 ? byte : 0;
+        for (auto& seg : StrokeFont::glyph(c)) {
+            segments.emplace_back(
+                Vec2{seg.begin.x + x, seg.begin.y + y},
+                Vec2{seg.end.x + x, seg.end.y + y}
+            );
+        }
+        res->width  = std::max(res->width, x + glyphWidth);
+        x          += StrokeFont::advance;
+    }
+    res->height   = 1.0f - y;
+    res->segments = mergeCollinear(segments);
+    return res;
+}
+
+std::shared_ptr<StrokeFont::Layout const> StrokeFont::layout(std::string_view text) {
+    // 同一批标记通常只有少数几种文字，缓存满了直接清空
+    constexpr size_t maxCached = 4096;
+
+    static std::shared_mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<Layout const>> cache;
+    {
+        std::shared_lock l{mutex};
+        if (auto it = cache.find(std::string{text}); it != cache.end()) return it->second;
+    }
+    auto res = build(text);
+    std::unique_lock l{mutex};
+    if (cache.size() >= maxCached) cache.clear();
+    cache.emplace(text, res);
+    return res;
+}
+} // namespace bsci
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "bsci/Marcos.h"
+
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <mc/deps/core/math/Vec2.h>
+
+namespace bsci {
+// 单线矢量字体，供不支持原生文字的后端用线段拼出文字
+// 坐标以大写字母高度为1，第一行基线左端为原点，y轴向上
+class StrokeFont {
+public:
+    struct Segment {
+        Vec2 begin;
+        Vec2 end;
+    };
+
+    struct Layout {
+        std::vector<Segment> segments;
+        float                width{};  // 最长一行的宽度
+        float                height{}; // 第一行顶端到最后一行基线
+    };
+
+    static constexpr float advance    = 1.0f; // 字宽2/3，其余为字间距
+    static constexpr float lineHeight = 1.5f;
+
+    // 字形只在第一次使用时解析一次，不支持的字符显示为方框
+    BSCI_API static std::span<Segment const> glyph(char32_t c);
+
+    // 排版结果按文字缓存，共线且相接的笔画合为一段
+    BSCI_API static std::shared_ptr<Layout const> layout(std::string_view text);
+};
+} // namespace bsci
@@ -44,3 +44,20 @@ target("BedrockServerClientInterface")
             batchcmds:cp(path.join(assetsdir, "*"), outputdir)
         end
     end)
+
+-- xmake build bsci_bench
+-- 以模组形式加载，无需客户端在线，结果写入模组数据目录下的bench_output.txt
+target("bsci_bench")
+    set_default(false)
+    add_rules("@levibuildscript/linkrule")
+    add_rules("@levibuildscript/modpacker")
+    add_cxflags( "/EHa", "/utf-8", "/W4", "/w44265", "/w44289", "/w44296", "/w45263", "/w44738", "/w45204")
+    add_defines( "_HAS_CXX23=1", "NOMINMAX", "UNICODE", "BSCI_EXPORTS", "BENCH")
+    add_files("src/**.cpp|memory/MempryOperators.cpp")
+    add_includedirs("src")
+    add_packages("levilamina")
+    set_exceptions("none")
+    set_kind("shared")
+    set_languages("c++20")
+    set_symbols("debug")
+    set_optimize("fastest")